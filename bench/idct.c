@@ -0,0 +1,110 @@
+// Microbenchmark of the JPEG IDCT kernels in stb_image.h: the scalar reference,
+// SSE2 and the two-block AVX2 kernel. The AVX2 kernel is first checked against
+// SSE2 on random blocks, then all of them are timed on blocks that fit in L1.
+//
+//     make bench
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../src/stb_image.h"
+#include "../src/timer.c"
+
+#define BLOCKS 256
+#define ROUNDS 4000
+
+static STBI_SIMD_ALIGN(short, coefficients[BLOCKS][64]);
+static stbi_uc pixels[BLOCKS / 2][16 * 8];
+
+// Mostly small low frequency coefficients like a dequantized photo block, with
+// every so often a block of values all over the int16 range
+static void fill_blocks(unsigned seed)
+{
+    srand(seed);
+    for (int b = 0; b < BLOCKS; ++b) {
+        int wild = b % 16 == 15;
+        for (int i = 0; i < 64; ++i) {
+            int r = rand();
+            if (wild) coefficients[b][i] = (short)(r & 0xffff);
+            else if (i < 10 || r % 4 == 0) coefficients[b][i] = (short)(r % 2048 - 1024) / (1 + i / 4);
+            else coefficients[b][i] = 0;
+        }
+    }
+}
+
+typedef void (*Idct_Block)(stbi_uc *out, int out_stride, short data[64]);
+
+// Runs one block kernel over every pair of blocks, side by side like the two
+// block kernels
+static void run_block(Idct_Block idct)
+{
+    for (int b = 0; b < BLOCKS; b += 2) {
+        idct(pixels[b / 2], 16, coefficients[b]);
+        idct(pixels[b / 2] + 8, 16, coefficients[b + 1]);
+    }
+}
+
+static void run_scalar(void) { run_block(stbi__idct_block); }
+
+#ifdef STBI_SSE2
+static void run_sse2(void) { run_block(stbi__idct_simd); }
+#endif
+
+#ifdef STBI_AVX2
+static void run_avx2(void)
+{
+    for (int b = 0; b < BLOCKS; b += 2) stbi__idct_simd2_avx2(pixels[b / 2], 16, coefficients[b]);
+}
+#endif
+
+// Best of 5 in nanoseconds per block, compared against `scalar_ns` when given
+static double bench(const char *name, void (*run)(void), double scalar_ns)
+{
+    double best = 1e30;
+    for (int repeat = 0; repeat < 5; ++repeat) {
+        double start = timer_now();
+        for (int round = 0; round < ROUNDS; ++round) run();
+        double seconds = timer_now() - start;
+        if (seconds < best) best = seconds;
+    }
+    double ns = best * 1e9 / ((double)ROUNDS * BLOCKS);
+    printf("%-8s %6.2f ns/block", name, ns);
+    if (scalar_ns > 0) printf("  %.2fx scalar", scalar_ns / ns);
+    printf("\n");
+    return ns;
+}
+
+int main(void)
+{
+#if defined(STBI_SSE2) && defined(STBI_AVX2)
+    // the avx2 kernel has to match sse2 bit for bit, overflowing blocks included
+    if (stbi__avx2_available()) {
+        static stbi_uc reference[BLOCKS / 2][16 * 8];
+        for (unsigned seed = 1; seed <= 200; ++seed) {
+            fill_blocks(seed);
+            run_sse2();
+            memcpy(reference, pixels, sizeof(reference));
+            run_avx2();
+            if (memcmp(reference, pixels, sizeof(reference)) != 0) {
+                printf("avx2 differs from sse2 (seed %u)\n", seed);
+                return 1;
+            }
+        }
+        printf("avx2 matches sse2 on %d random blocks\n", 200 * BLOCKS);
+    }
+#endif
+
+    fill_blocks(1);
+    double scalar_ns = bench("scalar", run_scalar, 0);
+#ifdef STBI_SSE2
+    bench("sse2", run_sse2, scalar_ns);
+#endif
+#ifdef STBI_AVX2
+    if (stbi__avx2_available()) bench("avx2", run_avx2, scalar_ns);
+    else printf("avx2     not supported by this CPU\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,224 @@
+// Microbenchmark of the JPEG back end kernels in stb_image.h: 2x2 chroma
+// upsampling (stbi__resample_row_hv_2) and YCbCr to RGBA conversion, scalar,
+// SSE2 and AVX2, and the AVX2 kernel that does both in one pass for 4:2:2. A
+// 4:2:0 version of it is kept here only to show it does not pay off. The AVX2
+// kernels are first checked against SSE2 on random rows of every width up to
+// 200, then all of them are timed on one 1920 pixel row.
+//
+//     make bench
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../src/stb_image.h"
+#include "../src/timer.c"
+
+#define WIDTH 1920
+#define ROUNDS 2000
+
+static stbi_uc near_row[WIDTH + 16], far_row[WIDTH + 16];
+static stbi_uc luma[2 * WIDTH], cb[2 * WIDTH], cr[2 * WIDTH];
+static stbi_uc upsampled[2 * WIDTH + 32], upsampled_cr[2 * WIDTH + 32], rgba[8 * WIDTH + 64];
+
+typedef stbi_uc *(*Resample)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
+typedef void (*Convert)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
+
+static void fill_rows(void)
+{
+    for (int i = 0; i < WIDTH + 16; ++i) {
+        near_row[i] = (stbi_uc)rand();
+        far_row[i] = (stbi_uc)rand();
+    }
+    for (int i = 0; i < 2 * WIDTH; ++i) {
+        luma[i] = (stbi_uc)rand();
+        cb[i] = (stbi_uc)rand();
+        cr[i] = (stbi_uc)rand();
+    }
+}
+
+#ifdef STBI_AVX2
+// stbi__YCbCr_upsample_to_RGBA_avx2 for 4:2:0: the chroma rows filtered as in
+// stbi__resample_row_hv_2 and converted straight from registers
+static STBI_AVX2_TARGET void fused_420_avx2(stbi_uc *out, const stbi_uc *y, const stbi_uc *cb_near, const stbi_uc *cb_far,
+                                            const stbi_uc *cr_near, const stbi_uc *cr_far, int count)
+{
+    stbi_uc cb_row[32], cr_row[32];
+    int w = (count + 1) >> 1;
+    int i = 0;
+    int cb_t1 = 3 * cb_near[0] + cb_far[0], cr_t1 = 3 * cr_near[0] + cr_far[0];
+
+    for (; i + 16 < w; i += 16) {
+        __m256i yb = _mm256_loadu_si256((__m256i *)(y + i * 2));
+        __m256i cb0, cb1, cr0, cr1, a0, a1, b0, b1;
+        stbi__resample_hv_2_avx2_16(&cb0, &cb1, cb_near, cb_far, i);
+        stbi__resample_hv_2_avx2_16(&cr0, &cr1, cr_near, cr_far, i);
+        stbi__YCbCr_to_RGBA_avx2_16(&a0, &a1, _mm256_unpacklo_epi8(yb, _mm256_setzero_si256()), cb0, cr0);
+        stbi__YCbCr_to_RGBA_avx2_16(&b0, &b1, _mm256_unpackhi_epi8(yb, _mm256_setzero_si256()), cb1, cr1);
+        _mm_storeu_si128((__m128i *)(out + 0), _mm256_castsi256_si128(a0));
+        _mm_storeu_si128((__m128i *)(out + 16), _mm256_castsi256_si128(a1));
+        _mm_storeu_si128((__m128i *)(out + 32), _mm256_castsi256_si128(b0));
+        _mm_storeu_si128((__m128i *)(out + 48), _mm256_castsi256_si128(b1));
+        _mm_storeu_si128((__m128i *)(out + 64), _mm256_extracti128_si256(a0, 1));
+        _mm_storeu_si128((__m128i *)(out + 80), _mm256_extracti128_si256(a1, 1));
+        _mm_storeu_si128((__m128i *)(out + 96), _mm256_extracti128_si256(b0, 1));
+        _mm_storeu_si128((__m128i *)(out + 112), _mm256_extracti128_si256(b1, 1));
+        cb_t1 = 3 * cb_near[i + 15] + cb_far[i + 15];
+        cr_t1 = 3 * cr_near[i + 15] + cr_far[i + 15];
+        out += 128;
+    }
+    for (int k = i; k < w; ++k) {
+        int cb_t = 3 * cb_near[k] + cb_far[k], cr_t = 3 * cr_near[k] + cr_far[k];
+        int o = (k - i) * 2;
+        cb_row[o] = k == 0 ? stbi__div4(cb_t + 2) : stbi__div16(3 * cb_t + cb_t1 + 8);
+        cr_row[o] = k == 0 ? stbi__div4(cr_t + 2) : stbi__div16(3 * cr_t + cr_t1 + 8);
+        cb_row[o + 1] = k == w - 1 ? stbi__div4(cb_t + 2) : stbi__div16(3 * cb_t + 3 * cb_near[k + 1] + cb_far[k + 1] + 8);
+        cr_row[o + 1] = k == w - 1 ? stbi__div4(cr_t + 2) : stbi__div16(3 * cr_t + 3 * cr_near[k + 1] + cr_far[k + 1] + 8);
+        cb_t1 = cb_t;
+        cr_t1 = cr_t;
+    }
+    stbi__YCbCr_to_RGB_simd(out, y + i * 2, cb_row, cr_row, count - i * 2, 4);
+}
+#endif
+
+#if defined(STBI_SSE2) && defined(STBI_AVX2)
+// Compares `avx2` against `sse2` for every width up to 200, returns 0 on a mismatch
+static int check(Resample sse2_resample, Resample avx2_resample, Convert sse2_convert, Convert avx2_convert)
+{
+    static stbi_uc expected[8 * WIDTH + 64];
+    for (int round = 0; round < 20; ++round) {
+        fill_rows();
+        for (int w = 1; w <= 200; ++w) {
+            memset(expected, 0, sizeof(expected));
+            memset(upsampled, 0, sizeof(upsampled));
+            sse2_resample(expected, near_row, far_row, w, 2);
+            avx2_resample(upsampled, near_row, far_row, w, 2);
+            if (memcmp(expected, upsampled, sizeof(upsampled)) != 0) {
+                printf("avx2 upsampling differs from sse2 at width %d\n", w);
+                return 0;
+            }
+            for (int step = 3; step <= 4; ++step) {
+                memset(expected, 0, sizeof(expected));
+                memset(rgba, 0, sizeof(rgba));
+                sse2_convert(expected, luma, cb, cr, w, step);
+                avx2_convert(rgba, luma, cb, cr, w, step);
+                if (memcmp(expected, rgba, sizeof(rgba)) != 0) {
+                    printf("avx2 color conversion differs from sse2 at width %d, step %d\n", w, step);
+                    return 0;
+                }
+            }
+            // 4:2:0 against hv_2 then conversion, 4:2:2 against h_2 then conversion
+            for (int count = 2 * w - 1; count <= 2 * w; ++count) {
+                for (int vs = 1; vs <= 2; ++vs) {
+                    Resample resample = vs == 2 ? sse2_resample : stbi__resample_row_h_2;
+                    memset(expected, 0, sizeof(expected));
+                    memset(rgba, 0, sizeof(rgba));
+                    resample(upsampled, near_row, far_row, w, 2);
+                    resample(upsampled_cr, far_row, near_row, w, 2);
+                    sse2_convert(expected, luma, upsampled, upsampled_cr, count, 4);
+                    if (vs == 2) fused_420_avx2(rgba, luma, near_row, far_row, far_row, near_row, count);
+                    else stbi__YCbCr_upsample_to_RGBA_avx2(rgba, luma, near_row, far_row, count);
+                    if (memcmp(expected, rgba, sizeof(rgba)) != 0) {
+                        printf("avx2 fused upsampling differs from sse2 at %d pixels, vs %d\n", count, vs);
+                        return 0;
+                    }
+                }
+            }
+        }
+    }
+    return 1;
+}
+#endif
+
+#ifdef STBI_AVX2
+// Best of 5 in nanoseconds per output pixel for both chroma rows of a 4:2:0
+// (vs 2) or 4:2:2 (vs 1) row, upsampled and converted in two passes or in one
+static double bench_fused(int vs, int fused, double separate_ns)
+{
+    double best = 1e30;
+    for (int repeat = 0; repeat < 5; ++repeat) {
+        double start = timer_now();
+        for (int round = 0; round < ROUNDS; ++round) {
+            if (fused && vs == 2) {
+                fused_420_avx2(rgba, luma, near_row, far_row, far_row, near_row, 2 * WIDTH);
+            } else if (fused) {
+                stbi__YCbCr_upsample_to_RGBA_avx2(rgba, luma, near_row, far_row, 2 * WIDTH);
+            } else {
+                Resample resample = vs == 2 ? stbi__resample_row_hv_2_avx2 : stbi__resample_row_h_2;
+                resample(upsampled, near_row, far_row, WIDTH, 2);
+                resample(upsampled_cr, far_row, near_row, WIDTH, 2);
+                stbi__YCbCr_to_RGB_avx2(rgba, luma, upsampled, upsampled_cr, 2 * WIDTH, 4);
+            }
+        }
+        double seconds = timer_now() - start;
+        if (seconds < best) best = seconds;
+    }
+    double ns = best * 1e9 / ((double)ROUNDS * 2 * WIDTH);
+    printf("  %-8s %6.3f ns/pixel", fused ? "fused" : "separate", ns);
+    if (separate_ns > 0) printf("  %.2fx separate", separate_ns / ns);
+    printf("\n");
+    return ns;
+}
+#endif
+
+// Best of 5 in nanoseconds per output pixel, compared against `scalar_ns` when given
+static double bench(const char *name, Resample resample, Convert convert, double scalar_ns)
+{
+    double best = 1e30;
+    for (int repeat = 0; repeat < 5; ++repeat) {
+        double start = timer_now();
+        for (int round = 0; round < ROUNDS; ++round) {
+            if (resample != NULL) resample(upsampled, near_row, far_row, WIDTH, 2);
+            else convert(rgba, luma, cb, cr, 2 * WIDTH, 4);
+        }
+        double seconds = timer_now() - start;
+        if (seconds < best) best = seconds;
+    }
+    double ns = best * 1e9 / ((double)ROUNDS * 2 * WIDTH);
+    printf("  %-8s %6.3f ns/pixel", name, ns);
+    if (scalar_ns > 0) printf("  %.2fx scalar", scalar_ns / ns);
+    printf("\n");
+    return ns;
+}
+
+int main(void)
+{
+    int avx2 = 0;
+#if defined(STBI_SSE2) && defined(STBI_AVX2)
+    avx2 = stbi__avx2_available();
+    if (avx2) {
+        if (!check(stbi__resample_row_hv_2_simd, stbi__resample_row_hv_2_avx2,
+                   stbi__YCbCr_to_RGB_simd, stbi__YCbCr_to_RGB_avx2)) return 1;
+        printf("avx2 matches sse2 on every width up to 200\n");
+    }
+#endif
+    fill_rows();
+
+    printf("resample_row_hv_2, %d to %d pixels\n", WIDTH, 2 * WIDTH);
+    double scalar_ns = bench("scalar", stbi__resample_row_hv_2, NULL, 0);
+#ifdef STBI_SSE2
+    bench("sse2", stbi__resample_row_hv_2_simd, NULL, scalar_ns);
+#endif
+#ifdef STBI_AVX2
+    if (avx2) bench("avx2", stbi__resample_row_hv_2_avx2, NULL, scalar_ns);
+#endif
+
+    printf("YCbCr_to_RGB, %d pixels to RGBA\n", 2 * WIDTH);
+    scalar_ns = bench("scalar", NULL, stbi__YCbCr_to_RGB_row, 0);
+#ifdef STBI_SSE2
+    bench("sse2", NULL, stbi__YCbCr_to_RGB_simd, scalar_ns);
+#endif
+#ifdef STBI_AVX2
+    if (avx2) bench("avx2", NULL, stbi__YCbCr_to_RGB_avx2, scalar_ns);
+    else printf("  avx2     not supported by this CPU\n");
+
+    for (int vs = 2; avx2 && vs >= 1; --vs) {
+        printf("%s chroma upsampling and YCbCr_to_RGB, %d pixels to RGBA, avx2\n", vs == 2 ? "4:2:0" : "4:2:2", 2 * WIDTH);
+        double separate_ns = bench_fused(vs, 0, 0);
+        bench_fused(vs, 1, separate_ns);
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef IMAGE2C_LAZY_H_
+#define IMAGE2C_LAZY_H_
+
+// Runtime side of `image2c --decode lazy`: the header carries the original PNG,
+// JPEG, ... file in NAME[] and NAME_FILE_SIZE, and NAME_PIXELS() decodes it with
+// stb_image the first time it is called. The RGBA8888 pixels are kept until
+// image2c_lazy_release(). The cache is not locked, call NAME_PIXELS() once before
+// sharing the pixels between threads.
+//
+// stb_image has to be compiled into the program once. Building it with only the
+// formats of the lazy assets keeps the decoder small, every header says which
+// one it needs in its NAME_PIXELS() comment:
+//
+//     #define STBI_ONLY_PNG
+//     #define STBI_ONLY_JPEG
+//     #define IMAGE2C_LAZY_IMPLEMENTATION
+//     #include "image2c_lazy.h"
+//
+// IMAGE2C_LAZY_IMPLEMENTATION also sets STBI_NO_STDIO, the files are only ever
+// read from memory. Leave it out when the program builds stb_image itself.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(IMAGE2C_LAZY_IMPLEMENTATION) && !defined(STB_IMAGE_IMPLEMENTATION)
+#define STB_IMAGE_IMPLEMENTATION
+#ifndef STBI_NO_STDIO
+#define STBI_NO_STDIO
+#endif
+#endif
+#include "stb_image.h"
+
+typedef struct {
+    uint32_t *pixels;       // NULL until the first decode
+    int width, height;
+} image2c_lazy;
+
+// Pixels of the `file_size` byte image `file`, decoded into `cache` on the first
+// call. Returns NULL when the file cannot be decoded.
+static inline const uint32_t *image2c_lazy_pixels(image2c_lazy *cache, const void *file, size_t file_size)
+{
+    if (cache->pixels == NULL) {
+        int channels;
+        cache->pixels = (uint32_t *)stbi_load_from_memory((const stbi_uc *)file, (int)file_size,
+                                                          &cache->width, &cache->height, &channels, 4);
+    }
+    return cache->pixels;
+}
+
+// Frees the decoded pixels, the next call to image2c_lazy_pixels() decodes again
+static inline void image2c_lazy_release(image2c_lazy *cache)
+{
+    stbi_image_free(cache->pixels);
+    cache->pixels = NULL;
+}
+
+#endif // IMAGE2C_LAZY_H_
@@ -0,0 +1,90 @@
+#ifndef IMAGE2C_LZ4_H_
+#define IMAGE2C_LZ4_H_
+
+// Decoder for the arrays written by `image2c -c lz4`: a single raw LZ4 block
+// (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md) holding the
+// serialized pixel units, NAME_RAW_SIZE bytes once decoded.
+//
+// The decoder is bounds checked against both buffers, needs no scratch memory and
+// compiles to a few hundred bytes of code.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Decodes `src_size` bytes of `src` into `dst` of `dst_size` bytes, returns the
+// number of bytes written or -1 when the stream is malformed
+static inline long image2c_lz4_decode(const uint8_t *src, size_t src_size, void *dst, size_t dst_size)
+{
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + src_size;
+    uint8_t *op = (uint8_t *)dst;
+    uint8_t *oend = op + dst_size;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            unsigned b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > (size_t)(iend - ip) || literals > (size_t)(oend - op)) return -1;
+        if (literals <= 16 && iend - ip >= 16 && oend - op >= 16) {
+            // short literal runs: one fixed size copy, the overshoot gets overwritten
+            memcpy(op, ip, 16);
+        } else {
+            memcpy(op, ip, literals);
+        }
+        op += literals;
+        ip += literals;
+        if (ip == iend) break;      // the last sequence has no match
+
+        if (iend - ip < 2) return -1;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (uint8_t *)dst)) return -1;
+
+        size_t length = (token & 15) + 4;
+        if ((token & 15) == 15) {
+            unsigned b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        if (length > (size_t)(oend - op)) return -1;
+
+        const uint8_t *from = op - offset;
+        if (offset >= 16 && (size_t)(oend - op) >= length + 16) {
+            // copy 16 bytes at a time, each chunk only reads bytes already written
+            uint8_t *end = op + length;
+            do {
+                memcpy(op, from, 16);
+                op += 16;
+                from += 16;
+            } while (op < end);
+            op = end;
+        } else if (offset >= length) {
+            memcpy(op, from, length);
+            op += length;
+        } else {
+            // overlapping match: the copied span doubles every step
+            while (length > 0) {
+                size_t chunk = (size_t)(op - from);
+                if (chunk > length) chunk = length;
+                memcpy(op, from, chunk);
+                op += chunk;
+                length -= chunk;
+            }
+        }
+    }
+    return (long)(op - (uint8_t *)dst);
+}
+
+#endif // IMAGE2C_LZ4_H_
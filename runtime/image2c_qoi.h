@@ -0,0 +1,173 @@
+#ifndef IMAGE2C_QOI_H_
+#define IMAGE2C_QOI_H_
+
+// Decoder for the arrays written by `image2c -c qoi`: a complete QOI image
+// (https://qoiformat.org/qoi-specification.pdf) of the RGBA8 pixels, decoded
+// straight into any of the image2c pixel formats, NAME_QOI_FORMAT being the one
+// asked for with -f. Packed units are written in the byte order of the target.
+//
+// The decoder is bounds checked against both buffers and needs no memory besides
+// the 256 byte color index on the stack.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Same values as the -f formats of image2c
+#define IMAGE2C_PIXFMT_RGBA8888       0     // uint32_t 0xAABBGGRR
+#define IMAGE2C_PIXFMT_RGB565         1     // uint16_t, red in the top bits
+#define IMAGE2C_PIXFMT_RGB565_SWAPPED 2     // RGB565 with its two bytes exchanged
+#define IMAGE2C_PIXFMT_RGBA4444       3     // uint16_t, red in the top bits
+#define IMAGE2C_PIXFMT_RGBA5551       4     // uint16_t, red in the top bits
+#define IMAGE2C_PIXFMT_RGB332         5     // uint8_t, red in the top bits
+#define IMAGE2C_PIXFMT_L8             6     // uint8_t BT.601 luma
+#define IMAGE2C_PIXFMT_LA8            7     // uint16_t, luma low, alpha high
+
+#define IMAGE2C_QOI_OP_INDEX 0x00
+#define IMAGE2C_QOI_OP_DIFF  0x40
+#define IMAGE2C_QOI_OP_LUMA  0x80
+#define IMAGE2C_QOI_OP_RUN   0xc0
+#define IMAGE2C_QOI_OP_RGB   0xfe
+#define IMAGE2C_QOI_OP_RGBA  0xff
+#define IMAGE2C_QOI_HEADER_SIZE 14
+#define IMAGE2C_QOI_PADDING     8
+
+static inline uint32_t image2c_qoi_read32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Width and height from the QOI header, returns 0 when `src` is not a QOI image
+static inline int image2c_qoi_size(const uint8_t *src, size_t src_size, uint32_t *width, uint32_t *height)
+{
+    if (src_size < IMAGE2C_QOI_HEADER_SIZE + IMAGE2C_QOI_PADDING || memcmp(src, "qoif", 4) != 0) return 0;
+    *width = image2c_qoi_read32(src + 4);
+    *height = image2c_qoi_read32(src + 8);
+    return 1;
+}
+
+// Bytes per pixel of `format`
+static inline size_t image2c_pixfmt_unit_size(int format)
+{
+    switch (format) {
+    case IMAGE2C_PIXFMT_RGBA8888: return 4;
+    case IMAGE2C_PIXFMT_RGB332:
+    case IMAGE2C_PIXFMT_L8: return 1;
+    default: return 2;
+    }
+}
+
+// Converts one pixel (r, g, b, a in the low to high bytes of `px`) to `format`
+static inline uint32_t image2c_pixfmt_pack(int format, uint32_t px)
+{
+    uint32_t r = px & 0xff, g = (px >> 8) & 0xff, b = (px >> 16) & 0xff, a = px >> 24;
+    uint32_t v;
+
+    switch (format) {
+    case IMAGE2C_PIXFMT_RGBA8888: return px;
+    case IMAGE2C_PIXFMT_RGB565: return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    case IMAGE2C_PIXFMT_RGB565_SWAPPED:
+        v = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        return ((v & 0xff) << 8) | (v >> 8);
+    case IMAGE2C_PIXFMT_RGBA4444: return ((r >> 4) << 12) | ((g >> 4) << 8) | ((b >> 4) << 4) | (a >> 4);
+    case IMAGE2C_PIXFMT_RGBA5551: return ((r >> 3) << 11) | ((g >> 3) << 6) | ((b >> 3) << 1) | (a >> 7);
+    case IMAGE2C_PIXFMT_RGB332: return ((r >> 5) << 5) | ((g >> 5) << 2) | (b >> 6);
+    case IMAGE2C_PIXFMT_L8: return (77 * r + 150 * g + 29 * b + 128) >> 8;
+    default: return (a << 8) | ((77 * r + 150 * g + 29 * b + 128) >> 8);
+    }
+}
+
+static inline void image2c_pixfmt_store(int format, uint8_t *dst, uint32_t v)
+{
+    switch (image2c_pixfmt_unit_size(format)) {
+    case 1: *dst = (uint8_t)v; break;
+    case 2: { uint16_t u = (uint16_t)v; memcpy(dst, &u, 2); } break;
+    default: memcpy(dst, &v, 4); break;
+    }
+}
+
+// The decode loop for one `format`; it is only ever called with a constant so the
+// compiler folds the conversion into a loop of its own for every format
+static inline long image2c_qoi_decode_as(const uint8_t *src, size_t src_size, void *dst, size_t dst_size, int format)
+{
+    uint32_t width, height;
+    if (!image2c_qoi_size(src, src_size, &width, &height)) return -1;
+
+    size_t unit_size = image2c_pixfmt_unit_size(format);
+    size_t pixels = (size_t)width * height;
+    if (pixels > dst_size / unit_size) return -1;
+
+    uint32_t index[64] = {0};
+    uint32_t px = 0xff000000u;      // r, g, b, a in the low to high bytes
+    uint32_t packed = image2c_pixfmt_pack(format, px);
+    const uint8_t *ip = src + IMAGE2C_QOI_HEADER_SIZE;
+    const uint8_t *iend = src + src_size - IMAGE2C_QOI_PADDING;
+    uint8_t *op = (uint8_t *)dst;
+    uint8_t *oend = op + pixels * unit_size;
+
+    while (op < oend) {
+        if (ip >= iend) return -1;
+        unsigned b1 = *ip++;
+        size_t run = 1;
+
+        if (b1 == IMAGE2C_QOI_OP_RGB) {
+            if (iend - ip < 3) return -1;
+            px = (px & 0xff000000u) | ((uint32_t)ip[2] << 16) | ((uint32_t)ip[1] << 8) | ip[0];
+            ip += 3;
+        } else if (b1 == IMAGE2C_QOI_OP_RGBA) {
+            if (iend - ip < 4) return -1;
+            px = ((uint32_t)ip[3] << 24) | ((uint32_t)ip[2] << 16) | ((uint32_t)ip[1] << 8) | ip[0];
+            ip += 4;
+        } else if ((b1 & 0xc0) == IMAGE2C_QOI_OP_INDEX) {
+            px = index[b1];
+            goto store;     // already in the index
+        } else if ((b1 & 0xc0) == IMAGE2C_QOI_OP_DIFF) {
+            uint32_t r = (px + ((b1 >> 4) & 3) - 2) & 0xff;
+            uint32_t g = ((px >> 8) + ((b1 >> 2) & 3) - 2) & 0xff;
+            uint32_t b = ((px >> 16) + (b1 & 3) - 2) & 0xff;
+            px = (px & 0xff000000u) | (b << 16) | (g << 8) | r;
+        } else if ((b1 & 0xc0) == IMAGE2C_QOI_OP_LUMA) {
+            if (ip >= iend) return -1;
+            unsigned b2 = *ip++;
+            uint32_t vg = (b1 & 0x3f) - 32;
+            uint32_t r = (px + vg - 8 + ((b2 >> 4) & 0x0f)) & 0xff;
+            uint32_t g = ((px >> 8) + vg) & 0xff;
+            uint32_t b = ((px >> 16) + vg - 8 + (b2 & 0x0f)) & 0xff;
+            px = (px & 0xff000000u) | (b << 16) | (g << 8) | r;
+        } else {
+            // OP_RUN repeats the previous pixel, which is already packed
+            run = (size_t)(b1 & 0x3f) + 1;
+            if (run > (size_t)(oend - op) / unit_size) return -1;
+            for (size_t i = 0; i < run; ++i, op += unit_size) image2c_pixfmt_store(format, op, packed);
+            continue;
+        }
+        {
+            uint32_t r = px & 0xff, g = (px >> 8) & 0xff, b = (px >> 16) & 0xff, a = px >> 24;
+            index[(r * 3 + g * 5 + b * 7 + a * 11) & 63] = px;
+        }
+    store:
+        packed = image2c_pixfmt_pack(format, px);
+        image2c_pixfmt_store(format, op, packed);
+        op += unit_size;
+    }
+    return (long)pixels;
+}
+
+// Decodes the QOI image in `src` into `dst` of `dst_size` bytes as `format`,
+// returns the number of pixels written or -1 when the stream is malformed
+static inline long image2c_qoi_decode(const uint8_t *src, size_t src_size, void *dst, size_t dst_size, int format)
+{
+    switch (format) {
+    case IMAGE2C_PIXFMT_RGBA8888: return image2c_qoi_decode_as(src, src_size, dst, dst_size, IMAGE2C_PIXFMT_RGBA8888);
+    case IMAGE2C_PIXFMT_RGB565: return image2c_qoi_decode_as(src, src_size, dst, dst_size, IMAGE2C_PIXFMT_RGB565);
+    case IMAGE2C_PIXFMT_RGB565_SWAPPED: return image2c_qoi_decode_as(src, src_size, dst, dst_size, IMAGE2C_PIXFMT_RGB565_SWAPPED);
+    case IMAGE2C_PIXFMT_RGBA4444: return image2c_qoi_decode_as(src, src_size, dst, dst_size, IMAGE2C_PIXFMT_RGBA4444);
+    case IMAGE2C_PIXFMT_RGBA5551: return image2c_qoi_decode_as(src, src_size, dst, dst_size, IMAGE2C_PIXFMT_RGBA5551);
+    case IMAGE2C_PIXFMT_RGB332: return image2c_qoi_decode_as(src, src_size, dst, dst_size, IMAGE2C_PIXFMT_RGB332);
+    case IMAGE2C_PIXFMT_L8: return image2c_qoi_decode_as(src, src_size, dst, dst_size, IMAGE2C_PIXFMT_L8);
+    case IMAGE2C_PIXFMT_LA8: return image2c_qoi_decode_as(src, src_size, dst, dst_size, IMAGE2C_PIXFMT_LA8);
+    default: return -1;
+    }
+}
+
+#endif // IMAGE2C_QOI_H_
@@ -0,0 +1,63 @@
+#ifndef IMAGE2C_RLE_H_
+#define IMAGE2C_RLE_H_
+
+// Decoder for the run-length encoded arrays written by `image2c -c rle`.
+//
+// Every row is encoded on its own, NAME_ROWS[y] is the offset of row y in NAME and
+// NAME_ROWS[NAME_HEIGHT] the total size. A row is a sequence of packets made of one
+// control byte c followed by pixel units of `unit_size` bytes:
+//   c <  0x80: c + 1 literal units follow
+//   c >= 0x80: one unit follows and is repeated (c & 0x7f) + 2 times
+// Units are stored in the byte order image2c was asked for, which must match the
+// target when they are copied straight into the destination.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Expands one row of `units` pixel units into `dst`, returns the end of the row in `src`
+static inline const uint8_t *image2c_rle_decode_row(const uint8_t *src, void *dst, size_t units, size_t unit_size)
+{
+    uint8_t *out = (uint8_t *)dst;
+    uint8_t *end = out + units * unit_size;
+
+    while (out < end) {
+        unsigned c = *src++;
+        if (c < 0x80) {
+            size_t n = (size_t)(c + 1) * unit_size;
+            memcpy(out, src, n);
+            out += n;
+            src += n;
+        } else {
+            size_t count = (size_t)(c & 0x7f) + 2;
+            size_t n = count * unit_size;
+            if (unit_size == 1) {
+                memset(out, *src, n);
+            } else {
+                // store the unit once, then keep doubling the filled part
+                size_t filled = unit_size;
+                memcpy(out, src, unit_size);
+                while (filled < n) {
+                    size_t chunk = filled < n - filled ? filled : n - filled;
+                    memcpy(out + filled, out, chunk);
+                    filled += chunk;
+                }
+            }
+            out += n;
+            src += unit_size;
+        }
+    }
+    return src;
+}
+
+// Expands `height` rows of `row_units` units each into `dst`
+static inline void image2c_rle_decode(const uint8_t *src, void *dst, size_t row_units, size_t height, size_t unit_size)
+{
+    uint8_t *out = (uint8_t *)dst;
+    for (size_t y = 0; y < height; ++y) {
+        src = image2c_rle_decode_row(src, out, row_units, unit_size);
+        out += row_units * unit_size;
+    }
+}
+
+#endif // IMAGE2C_RLE_H_
@@ -0,0 +1,240 @@
+#ifndef IMAGE2C_TEXTURE_H_
+#define IMAGE2C_TEXTURE_H_
+
+// Reference decoder for the block compressed textures written by
+// `image2c -t FORMAT`. Most targets hand NAME straight to the GPU; this header is
+// for checking the blocks on the CPU and for targets without the hardware format.
+//
+// Blocks cover 4x4 pixels, are stored row by row and the image is padded to a
+// multiple of 4 by repeating its last column and row:
+//   IMAGE2C_BC1   8 bytes, RGB with 1-bit alpha
+//   IMAGE2C_BC3  16 bytes, BC4 alpha block then a BC1 color block (always 4 colors)
+//   IMAGE2C_BC4   8 bytes, one channel, decoded as (r, 0, 0, 255)
+//   IMAGE2C_BC5  16 bytes, two BC4 blocks, decoded as (r, g, 0, 255)
+//   IMAGE2C_ETC1  8 bytes, RGB
+//   IMAGE2C_ETC2 16 bytes, ETC2 RGBA8: EAC alpha block then an ETC2 color block.
+//                Only the ETC1 compatible color modes are decoded, which are the
+//                only ones image2c writes; T, H and planar blocks decode as black.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define IMAGE2C_BC1  1
+#define IMAGE2C_BC3  2
+#define IMAGE2C_BC4  3
+#define IMAGE2C_BC5  4
+#define IMAGE2C_ETC1 5
+#define IMAGE2C_ETC2 6
+
+static const int image2c_etc1_modifiers[8][2] = {
+    {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183},
+};
+
+static const int image2c_eac_modifiers[16][8] = {
+    {-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12},
+    {-2, -5, -8, -13, 1, 4, 7, 12}, {-2, -4, -6, -13, 1, 3, 5, 12},
+    {-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10},
+    {-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10},
+    {-2, -6, -8, -10, 1, 5, 7, 9},  {-2, -5, -8, -10, 1, 4, 7, 9},
+    {-2, -4, -8, -10, 1, 3, 7, 9},  {-2, -5, -7, -10, 1, 4, 6, 9},
+    {-3, -4, -7, -10, 2, 3, 6, 9},  {-1, -2, -3, -10, 0, 1, 2, 9},
+    {-4, -6, -8, -9, 3, 5, 7, 8},   {-3, -5, -7, -9, 2, 4, 6, 8},
+};
+
+// Bytes per 4x4 block of `format`
+static inline size_t image2c_texture_block_size(int format)
+{
+    return format == IMAGE2C_BC3 || format == IMAGE2C_BC5 || format == IMAGE2C_ETC2 ? 16 : 8;
+}
+
+static inline uint8_t image2c_texture_clamp(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+// The 4 RGBA colors of a BC1 block; 3 colors and transparent black when
+// color0 <= color1, unless `four_colors` is set as in BC3
+static inline void image2c_bc1_palette(const uint8_t *block, int four_colors, uint8_t palette[4][4])
+{
+    unsigned c0 = block[0] | (unsigned)block[1] << 8;
+    unsigned c1 = block[2] | (unsigned)block[3] << 8;
+    unsigned c[2] = {c0, c1};
+
+    for (int i = 0; i < 2; ++i) {
+        unsigned r = (c[i] >> 11) & 31, g = (c[i] >> 5) & 63, b = c[i] & 31;
+        palette[i][0] = (uint8_t)(r << 3 | r >> 2);
+        palette[i][1] = (uint8_t)(g << 2 | g >> 4);
+        palette[i][2] = (uint8_t)(b << 3 | b >> 2);
+        palette[i][3] = 255;
+    }
+    for (int ch = 0; ch < 3; ++ch) {
+        int a = palette[0][ch], b = palette[1][ch];
+        if (four_colors || c0 > c1) {
+            palette[2][ch] = (uint8_t)((2 * a + b + 1) / 3);
+            palette[3][ch] = (uint8_t)((a + 2 * b + 1) / 3);
+        } else {
+            palette[2][ch] = (uint8_t)((a + b + 1) / 2);
+            palette[3][ch] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = four_colors || c0 > c1 ? 255 : 0;
+}
+
+// The 8 values of a BC4 block
+static inline void image2c_bc4_palette(const uint8_t *block, uint8_t palette[8])
+{
+    int e0 = block[0], e1 = block[1];
+    palette[0] = (uint8_t)e0;
+    palette[1] = (uint8_t)e1;
+    if (e0 > e1) {
+        for (int i = 1; i < 7; ++i) palette[i + 1] = (uint8_t)(((7 - i) * e0 + i * e1 + 3) / 7);
+    } else {
+        for (int i = 1; i < 5; ++i) palette[i + 1] = (uint8_t)(((5 - i) * e0 + i * e1 + 2) / 5);
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// Writes the 16 values of a BC4 block to `out`, `stride` bytes apart
+static inline void image2c_bc4_decode(const uint8_t *block, uint8_t *out, size_t stride)
+{
+    uint8_t palette[8];
+    uint64_t bits = 0;
+
+    image2c_bc4_palette(block, palette);
+    for (int i = 0; i < 6; ++i) bits |= (uint64_t)block[2 + i] << (8 * i);
+    for (int i = 0; i < 16; ++i) out[i * stride] = palette[(bits >> (3 * i)) & 7];
+}
+
+static inline void image2c_bc1_decode(const uint8_t *block, int four_colors, uint8_t rgba[64])
+{
+    uint8_t palette[4][4];
+    uint32_t bits = block[4] | (uint32_t)block[5] << 8 | (uint32_t)block[6] << 16 | (uint32_t)block[7] << 24;
+
+    image2c_bc1_palette(block, four_colors, palette);
+    for (int i = 0; i < 16; ++i) memcpy(rgba + 4 * i, palette[(bits >> (2 * i)) & 3], 4);
+}
+
+static inline uint64_t image2c_etc_read64(const uint8_t *block)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = v << 8 | block[i];
+    return v;
+}
+
+// The base colors of the two sub-blocks of an ETC1 block, returns 0 for the ETC2
+// T, H and planar modes
+static inline int image2c_etc1_bases(uint64_t bits, int base[2][3])
+{
+    if (bits & ((uint64_t)1 << 33)) {
+        for (int ch = 0; ch < 3; ++ch) {
+            int c = (int)(bits >> (59 - 8 * ch)) & 31;
+            int d = (int)(bits >> (56 - 8 * ch)) & 7;
+            int c2 = c + (d >= 4 ? d - 8 : d);
+            if (c2 < 0 || c2 > 31) return 0;
+            base[0][ch] = c << 3 | c >> 2;
+            base[1][ch] = c2 << 3 | c2 >> 2;
+        }
+    } else {
+        for (int ch = 0; ch < 3; ++ch) {
+            int c1 = (int)(bits >> (60 - 8 * ch)) & 15;
+            int c2 = (int)(bits >> (56 - 8 * ch)) & 15;
+            base[0][ch] = c1 << 4 | c1;
+            base[1][ch] = c2 << 4 | c2;
+        }
+    }
+    return 1;
+}
+
+// Decodes the color of an ETC1 (or ETC1 compatible ETC2) block, alpha is left alone
+static inline void image2c_etc1_decode(const uint8_t *block, uint8_t rgba[64])
+{
+    uint64_t bits = image2c_etc_read64(block);
+    int base[2][3];
+    int flip = (int)(bits >> 32) & 1;
+
+    if (!image2c_etc1_bases(bits, base)) {
+        for (int i = 0; i < 16; ++i) rgba[4 * i] = rgba[4 * i + 1] = rgba[4 * i + 2] = 0;
+        return;
+    }
+    for (int x = 0; x < 4; ++x) {
+        for (int y = 0; y < 4; ++y) {
+            int sub = flip ? y >= 2 : x >= 2;
+            int table = (int)(bits >> (sub ? 34 : 37)) & 7;
+            int i = x * 4 + y;
+            int msb = (int)(bits >> (16 + i)) & 1, lsb = (int)(bits >> i) & 1;
+            int modifier = image2c_etc1_modifiers[table][lsb];
+            if (msb) modifier = -modifier;
+            for (int ch = 0; ch < 3; ++ch) rgba[4 * (y * 4 + x) + ch] = image2c_texture_clamp(base[sub][ch] + modifier);
+        }
+    }
+}
+
+// Decodes an EAC alpha block into every 4th byte of `rgba`
+static inline void image2c_eac_decode(const uint8_t *block, uint8_t rgba[64])
+{
+    uint64_t bits = image2c_etc_read64(block);
+    int base = (int)(bits >> 56);
+    int multiplier = (int)(bits >> 52) & 15;
+    const int *modifiers = image2c_eac_modifiers[(bits >> 48) & 15];
+
+    for (int i = 0; i < 16; ++i) {
+        int index = (int)(bits >> (45 - 3 * i)) & 7;
+        int x = i / 4, y = i % 4;
+        rgba[4 * (y * 4 + x) + 3] = image2c_texture_clamp(base + modifiers[index] * multiplier);
+    }
+}
+
+// Decodes one block into 4x4 RGBA8 pixels, rows of 16 bytes
+static inline void image2c_texture_decode_block(int format, const uint8_t *block, uint8_t rgba[64])
+{
+    switch (format) {
+    case IMAGE2C_BC1:
+        image2c_bc1_decode(block, 0, rgba);
+        break;
+    case IMAGE2C_BC3:
+        image2c_bc1_decode(block + 8, 1, rgba);
+        image2c_bc4_decode(block, rgba + 3, 4);
+        break;
+    case IMAGE2C_BC4:
+    case IMAGE2C_BC5:
+        memset(rgba, 0, 64);
+        image2c_bc4_decode(block, rgba, 4);
+        if (format == IMAGE2C_BC5) image2c_bc4_decode(block + 8, rgba + 1, 4);
+        for (int i = 0; i < 16; ++i) rgba[4 * i + 3] = 255;
+        break;
+    case IMAGE2C_ETC1:
+        image2c_etc1_decode(block, rgba);
+        for (int i = 0; i < 16; ++i) rgba[4 * i + 3] = 255;
+        break;
+    case IMAGE2C_ETC2:
+        image2c_etc1_decode(block + 8, rgba);
+        image2c_eac_decode(block, rgba);
+        break;
+    default:
+        memset(rgba, 0, 64);
+        break;
+    }
+}
+
+// Decodes a whole `width` x `height` texture into RGBA8 rows of `width` pixels
+static inline void image2c_texture_decode(int format, const uint8_t *src, size_t width, size_t height, uint8_t *rgba)
+{
+    size_t block_size = image2c_texture_block_size(format);
+    uint8_t pixels[64];
+
+    for (size_t by = 0; by < height; by += 4) {
+        for (size_t bx = 0; bx < width; bx += 4) {
+            image2c_texture_decode_block(format, src, pixels);
+            src += block_size;
+            for (size_t y = by; y < by + 4 && y < height; ++y) {
+                size_t n = width - bx < 4 ? width - bx : 4;
+                memcpy(rgba + 4 * (y * width + bx), pixels + 16 * (y - by), 4 * n);
+            }
+        }
+    }
+}
+
+#endif // IMAGE2C_TEXTURE_H_
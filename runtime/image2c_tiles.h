@@ -0,0 +1,91 @@
+#ifndef IMAGE2C_TILES_H_
+#define IMAGE2C_TILES_H_
+
+// Random access decoder for the tiled arrays written by `image2c --tile N`.
+//
+// The image is cut into N x N tiles (the last column and row may be narrower),
+// stored row by row and compressed one by one with RLE or LZ4. Tile i occupies
+// NAME[NAME_TILES[i] .. NAME_TILES[i + 1]). Reading a rectangle only decodes the
+// tiles it overlaps, so a scrolled window never pays for the whole image.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "image2c_rle.h"
+#include "image2c_lz4.h"
+
+#define IMAGE2C_TILE_RLE 1
+#define IMAGE2C_TILE_LZ4 2
+
+typedef struct {
+    const uint8_t *data;        // NAME
+    const uint32_t *offsets;    // NAME_TILES
+    uint32_t width;             // NAME_WIDTH
+    uint32_t height;            // NAME_HEIGHT
+    uint32_t tile_size;         // NAME_TILE_SIZE
+    uint32_t unit_size;         // NAME_UNIT_SIZE
+    uint32_t codec;             // NAME_TILE_CODEC
+} image2c_tiles;
+
+// Fills an image2c_tiles from the arrays and sizes of a generated header
+#define IMAGE2C_TILES(NAME) { NAME, NAME##_TILES, NAME##_WIDTH, NAME##_HEIGHT, \
+                              NAME##_TILE_SIZE, NAME##_UNIT_SIZE, NAME##_TILE_CODEC }
+
+static inline uint32_t image2c_tiles_across(const image2c_tiles *t)
+{
+    return (t->width + t->tile_size - 1) / t->tile_size;
+}
+
+// Decodes tile (tx, ty) into `dst`, rows of the tile's own width packed together.
+// Returns 0 on success, -1 when the tile data is malformed.
+static inline int image2c_tiles_decode_tile(const image2c_tiles *t, uint32_t tx, uint32_t ty, void *dst)
+{
+    uint32_t index = ty * image2c_tiles_across(t) + tx;
+    const uint8_t *src = t->data + t->offsets[index];
+    size_t src_size = t->offsets[index + 1] - t->offsets[index];
+    uint32_t tw = t->width - tx * t->tile_size < t->tile_size ? t->width - tx * t->tile_size : t->tile_size;
+    uint32_t th = t->height - ty * t->tile_size < t->tile_size ? t->height - ty * t->tile_size : t->tile_size;
+    size_t size = (size_t)tw * th * t->unit_size;
+
+    if (t->codec == IMAGE2C_TILE_RLE) {
+        image2c_rle_decode(src, dst, tw, th, t->unit_size);
+        return 0;
+    }
+    return image2c_lz4_decode(src, src_size, dst, size) == (long)size ? 0 : -1;
+}
+
+// Copies the w x h rectangle at (x, y) into `dst`, whose rows are `dst_stride`
+// bytes apart. `scratch` must hold one tile: tile_size * tile_size * unit_size bytes.
+// Returns 0 on success, -1 when the rectangle is out of bounds or a tile is malformed.
+static inline int image2c_tiles_read(const image2c_tiles *t, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                                     void *dst, size_t dst_stride, void *scratch)
+{
+    if (x > t->width || y > t->height || w > t->width - x || h > t->height - y) return -1;
+    if (w == 0 || h == 0) return 0;
+
+    uint32_t ts = t->tile_size;
+    for (uint32_t ty = y / ts; ty <= (y + h - 1) / ts; ++ty) {
+        for (uint32_t tx = x / ts; tx <= (x + w - 1) / ts; ++tx) {
+            if (image2c_tiles_decode_tile(t, tx, ty, scratch) != 0) return -1;
+
+            uint32_t tw = t->width - tx * ts < ts ? t->width - tx * ts : ts;
+            // overlap of the tile and the rectangle, in image coordinates
+            uint32_t x0 = tx * ts > x ? tx * ts : x;
+            uint32_t y0 = ty * ts > y ? ty * ts : y;
+            uint32_t x1 = tx * ts + tw < x + w ? tx * ts + tw : x + w;
+            uint32_t y1 = (ty + 1) * ts < y + h ? (ty + 1) * ts : y + h;
+
+            size_t row_bytes = (size_t)(x1 - x0) * t->unit_size;
+            for (uint32_t row = y0; row < y1; ++row) {
+                const uint8_t *from = (const uint8_t *)scratch
+                                    + ((size_t)(row - ty * ts) * tw + (x0 - tx * ts)) * t->unit_size;
+                uint8_t *to = (uint8_t *)dst + (size_t)(row - y) * dst_stride + (size_t)(x0 - x) * t->unit_size;
+                memcpy(to, from, row_bytes);
+            }
+        }
+    }
+    return 0;
+}
+
+#endif // IMAGE2C_TILES_H_
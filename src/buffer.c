@@ -0,0 +1,50 @@
+#ifndef BUFFER_C_
+#define BUFFER_C_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Growable byte buffer the encoders write their streams into
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} Byte_Buffer;
+
+void byte_buffer_reserve(Byte_Buffer *b, size_t extra)
+{
+    if (b->size + extra <= b->capacity) return;
+    size_t capacity = b->capacity ? b->capacity : 4096;
+    while (capacity < b->size + extra) capacity *= 2;
+    unsigned char *data = realloc(b->data, capacity);
+    if (data == NULL) {
+        fprintf(stderr, "ERROR: could not allocate %zu bytes\n", capacity);
+        exit(1);
+    }
+    b->data = data;
+    b->capacity = capacity;
+}
+
+void byte_buffer_push(Byte_Buffer *b, unsigned char byte)
+{
+    byte_buffer_reserve(b, 1);
+    b->data[b->size++] = byte;
+}
+
+void byte_buffer_append(Byte_Buffer *b, const void *bytes, size_t n)
+{
+    byte_buffer_reserve(b, n);
+    memcpy(b->data + b->size, bytes, n);
+    b->size += n;
+}
+
+void byte_buffer_free(Byte_Buffer *b)
+{
+    free(b->data);
+    b->data = NULL;
+    b->size = 0;
+    b->capacity = 0;
+}
+
+#endif // BUFFER_C_
@@ -0,0 +1,515 @@
+#ifndef DEFLATE_C_
+#define DEFLATE_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./buffer.c"
+#include "./emit.c"
+#include "./thread.c"
+#include "./timer.c"
+#include "./stb_image.h"
+
+// zlib (RFC 1950/1951) compressor for `-c zlib`, so the target can inflate the
+// pixels with stbi_zlib_decode_buffer() from the stb_image.h it already has.
+//
+// Like pigz, the input is cut into fixed size chunks that are deflated on their
+// own by the worker threads. Every chunk may still match against the 32K of input
+// before it, ends with an empty stored block to land on a byte boundary, and the
+// chunks are simply concatenated, so the stream is the same for any thread count.
+
+#define DEFLATE_WINDOW          32768
+#define DEFLATE_CHUNK           (128 * 1024)
+#define DEFLATE_HASH_BITS       15
+#define DEFLATE_MAX_CHAIN       48
+#define DEFLATE_GOOD_MATCH      64      // stop looking once a match is this long
+#define DEFLATE_MIN_MATCH       3
+#define DEFLATE_MAX_MATCH       258
+#define DEFLATE_BLOCK_SYMBOLS   32768   // symbols per Huffman block
+#define DEFLATE_LITLEN_CODES    286
+#define DEFLATE_DIST_CODES      30
+
+static const uint16_t deflate_length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t deflate_length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t deflate_dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const uint8_t deflate_dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+static const uint8_t deflate_code_length_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+// Length and distance code of every match length and distance
+static uint8_t deflate_length_code[DEFLATE_MAX_MATCH + 1];
+static uint8_t deflate_dist_code[DEFLATE_WINDOW + 1];
+static int deflate_tables_ready = 0;
+
+static void deflate_init_tables(void)
+{
+    if (deflate_tables_ready) return;
+    for (int code = 0; code < 29; ++code) {
+        for (int len = deflate_length_base[code]; len < deflate_length_base[code] + (1 << deflate_length_extra[code]) && len <= DEFLATE_MAX_MATCH; ++len) {
+            deflate_length_code[len] = (uint8_t)code;
+        }
+    }
+    // 258 also falls in the range of code 27, it has a code of its own
+    deflate_length_code[DEFLATE_MAX_MATCH] = 28;
+    for (int code = 0; code < 30; ++code) {
+        for (int d = deflate_dist_base[code]; d < deflate_dist_base[code] + (1 << deflate_dist_extra[code]) && d <= DEFLATE_WINDOW; ++d) {
+            deflate_dist_code[d] = (uint8_t)code;
+        }
+    }
+    deflate_tables_ready = 1;
+}
+
+typedef struct {
+    Byte_Buffer out;
+    uint64_t bits;
+    int bit_count;
+} Bit_Writer;
+
+static void bits_put(Bit_Writer *w, uint32_t value, int count)
+{
+    w->bits |= (uint64_t)value << w->bit_count;
+    w->bit_count += count;
+    while (w->bit_count >= 8) {
+        byte_buffer_push(&w->out, (unsigned char)w->bits);
+        w->bits >>= 8;
+        w->bit_count -= 8;
+    }
+}
+
+static void bits_align(Bit_Writer *w)
+{
+    if (w->bit_count > 0) bits_put(w, 0, 8 - w->bit_count);
+}
+
+typedef struct {
+    uint16_t litlen;        // literal byte, or match length when `dist` is set
+    uint16_t dist;
+} Deflate_Symbol;
+
+typedef struct {
+    int node;               // leaf symbol, or -1
+    uint32_t freq;
+    int left, right;
+} Huffman_Node;
+
+static int huffman_compare(const void *a, const void *b)
+{
+    const Huffman_Node *x = a, *y = b;
+    if (x->freq != y->freq) return x->freq < y->freq ? -1 : 1;
+    return x->node - y->node;
+}
+
+// Code lengths of at most `limit` bits for the `count` frequencies
+static void huffman_lengths(const uint32_t *freq, int count, int limit, uint8_t *lengths)
+{
+    uint32_t scaled[DEFLATE_LITLEN_CODES + 2];
+    Huffman_Node nodes[2 * (DEFLATE_LITLEN_CODES + 2)];
+    int depth[2 * (DEFLATE_LITLEN_CODES + 2)];
+
+    memcpy(scaled, freq, (size_t)count * sizeof(*scaled));
+    for (;;) {
+        int leaves = 0;
+        for (int i = 0; i < count; ++i) {
+            lengths[i] = 0;
+            if (scaled[i] > 0) nodes[leaves++] = (Huffman_Node){ i, scaled[i], -1, -1 };
+        }
+        if (leaves == 0) return;
+        if (leaves == 1) {
+            lengths[nodes[0].node] = 1;
+            return;
+        }
+        qsort(nodes, (size_t)leaves, sizeof(*nodes), huffman_compare);
+
+        // two queues: sorted leaves and internal nodes, which come out sorted too
+        int total = leaves, leaf = 0, inner = leaves;
+        while (total - leaves < leaves - 1) {
+            int pick[2];
+            for (int k = 0; k < 2; ++k) {
+                if (leaf < leaves && (inner >= total || nodes[leaf].freq <= nodes[inner].freq)) pick[k] = leaf++;
+                else pick[k] = inner++;
+            }
+            nodes[total] = (Huffman_Node){ -1, nodes[pick[0]].freq + nodes[pick[1]].freq, pick[0], pick[1] };
+            total += 1;
+        }
+
+        int max_depth = 0;
+        depth[total - 1] = 0;
+        for (int i = total - 1; i >= leaves; --i) {
+            depth[nodes[i].left] = depth[nodes[i].right] = depth[i] + 1;
+        }
+        for (int i = 0; i < leaves; ++i) {
+            lengths[nodes[i].node] = (uint8_t)depth[i];
+            if (depth[i] > max_depth) max_depth = depth[i];
+        }
+        if (max_depth <= limit) return;
+
+        // flatten the distribution and try again
+        for (int i = 0; i < count; ++i) {
+            if (scaled[i] > 0) scaled[i] = (scaled[i] + 1) / 2;
+        }
+    }
+}
+
+// Canonical codes for `lengths`, bit reversed for the LSB first writer
+static void huffman_codes(const uint8_t *lengths, int count, uint16_t *codes)
+{
+    int bl_count[16] = {0}, next_code[16] = {0};
+    for (int i = 0; i < count; ++i) bl_count[lengths[i]] += 1;
+    bl_count[0] = 0;
+    for (int bits = 1, code = 0; bits < 16; ++bits) {
+        code = (code + bl_count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+    for (int i = 0; i < count; ++i) {
+        int len = lengths[i];
+        if (len == 0) continue;
+        int code = next_code[len]++, reversed = 0;
+        for (int b = 0; b < len; ++b) reversed |= ((code >> b) & 1) << (len - 1 - b);
+        codes[i] = (uint16_t)reversed;
+    }
+}
+
+// Writes `count` symbols as one block with dynamic Huffman codes
+static void deflate_write_block(Bit_Writer *w, const Deflate_Symbol *symbols, size_t count, int final)
+{
+    uint32_t litlen_freq[DEFLATE_LITLEN_CODES] = {0}, dist_freq[DEFLATE_DIST_CODES] = {0};
+    uint8_t lengths[DEFLATE_LITLEN_CODES + DEFLATE_DIST_CODES];
+    uint16_t litlen_codes[DEFLATE_LITLEN_CODES], dist_codes[DEFLATE_DIST_CODES];
+
+    for (size_t i = 0; i < count; ++i) {
+        if (symbols[i].dist == 0) {
+            litlen_freq[symbols[i].litlen] += 1;
+        } else {
+            litlen_freq[257 + deflate_length_code[symbols[i].litlen]] += 1;
+            dist_freq[deflate_dist_code[symbols[i].dist]] += 1;
+        }
+    }
+    litlen_freq[256] = 1;
+
+    uint8_t *litlen_lengths = lengths, dist_lengths[DEFLATE_DIST_CODES];
+    huffman_lengths(litlen_freq, DEFLATE_LITLEN_CODES, 15, litlen_lengths);
+    huffman_lengths(dist_freq, DEFLATE_DIST_CODES, 15, dist_lengths);
+    huffman_codes(litlen_lengths, DEFLATE_LITLEN_CODES, litlen_codes);
+    huffman_codes(dist_lengths, DEFLATE_DIST_CODES, dist_codes);
+
+    int hlit = DEFLATE_LITLEN_CODES, hdist = DEFLATE_DIST_CODES;
+    while (hlit > 257 && litlen_lengths[hlit - 1] == 0) hlit -= 1;
+    while (hdist > 1 && dist_lengths[hdist - 1] == 0) hdist -= 1;
+    memmove(lengths + hlit, dist_lengths, (size_t)hdist);
+
+    // run-length encode the code lengths with symbols 16, 17 and 18
+    uint8_t cl_symbols[DEFLATE_LITLEN_CODES + DEFLATE_DIST_CODES], cl_extra[DEFLATE_LITLEN_CODES + DEFLATE_DIST_CODES];
+    uint32_t cl_freq[19] = {0};
+    int cl_count = 0, total = hlit + hdist;
+    for (int i = 0; i < total;) {
+        int len = lengths[i], run = 1;
+        while (i + run < total && lengths[i + run] == len) run += 1;
+        if (len == 0 && run >= 3) {
+            run = run > 138 ? 138 : run;
+            cl_symbols[cl_count] = run >= 11 ? 18 : 17;
+            cl_extra[cl_count++] = (uint8_t)(run >= 11 ? run - 11 : run - 3);
+        } else if (len != 0 && run >= 4) {
+            cl_symbols[cl_count] = (uint8_t)len;
+            cl_extra[cl_count++] = 0;
+            run = run - 1 > 6 ? 6 : run - 1;
+            cl_symbols[cl_count] = 16;
+            cl_extra[cl_count++] = (uint8_t)(run - 3);
+            run += 1;
+        } else {
+            run = 1;
+            cl_symbols[cl_count] = (uint8_t)len;
+            cl_extra[cl_count++] = 0;
+        }
+        i += run;
+    }
+    for (int i = 0; i < cl_count; ++i) cl_freq[cl_symbols[i]] += 1;
+
+    uint8_t cl_lengths[19];
+    uint16_t cl_codes[19];
+    huffman_lengths(cl_freq, 19, 7, cl_lengths);
+    huffman_codes(cl_lengths, 19, cl_codes);
+    int hclen = 19;
+    while (hclen > 4 && cl_lengths[deflate_code_length_order[hclen - 1]] == 0) hclen -= 1;
+
+    bits_put(w, (uint32_t)final, 1);
+    bits_put(w, 2, 2);
+    bits_put(w, (uint32_t)(hlit - 257), 5);
+    bits_put(w, (uint32_t)(hdist - 1), 5);
+    bits_put(w, (uint32_t)(hclen - 4), 4);
+    for (int i = 0; i < hclen; ++i) bits_put(w, cl_lengths[deflate_code_length_order[i]], 3);
+    for (int i = 0; i < cl_count; ++i) {
+        int s = cl_symbols[i];
+        bits_put(w, cl_codes[s], cl_lengths[s]);
+        if (s == 16) bits_put(w, cl_extra[i], 2);
+        else if (s == 17) bits_put(w, cl_extra[i], 3);
+        else if (s == 18) bits_put(w, cl_extra[i], 7);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const Deflate_Symbol *s = &symbols[i];
+        if (s->dist == 0) {
+            bits_put(w, litlen_codes[s->litlen], litlen_lengths[s->litlen]);
+            continue;
+        }
+        int lc = deflate_length_code[s->litlen], dc = deflate_dist_code[s->dist];
+        bits_put(w, litlen_codes[257 + lc], litlen_lengths[257 + lc]);
+        bits_put(w, s->litlen - deflate_length_base[lc], deflate_length_extra[lc]);
+        bits_put(w, dist_codes[dc], dist_lengths[dc]);
+        bits_put(w, s->dist - deflate_dist_base[dc], deflate_dist_extra[dc]);
+    }
+    bits_put(w, litlen_codes[256], litlen_lengths[256]);
+}
+
+static uint32_t deflate_hash(const unsigned char *p)
+{
+    uint32_t v = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+    return (v * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+typedef struct {
+    int32_t *head;
+    int32_t *prev;          // previous position with the same hash, by position - base
+    size_t base;
+} Match_Finder;
+
+static void match_insert(Match_Finder *m, const unsigned char *data, size_t pos)
+{
+    uint32_t h = deflate_hash(data + pos);
+    m->prev[pos - m->base] = m->head[h];
+    m->head[h] = (int32_t)(pos - m->base);
+}
+
+// Longest match for `pos` that ends before `end`, its distance goes to `dist`
+static size_t match_find(const Match_Finder *m, const unsigned char *data, size_t pos, size_t end, size_t *dist)
+{
+    size_t best = 0, limit = end - pos < DEFLATE_MAX_MATCH ? end - pos : DEFLATE_MAX_MATCH;
+    int32_t candidate = m->head[deflate_hash(data + pos)];
+
+    for (int chain = 0; chain < DEFLATE_MAX_CHAIN && candidate >= 0; ++chain) {
+        size_t c = (size_t)candidate + m->base;
+        if (pos - c > DEFLATE_WINDOW) break;
+        if (data[c + best] == data[pos + best]) {
+            size_t len = 0;
+            while (len < limit && data[c + len] == data[pos + len]) len += 1;
+            if (len > best) {
+                best = len;
+                *dist = pos - c;
+                if (len >= DEFLATE_GOOD_MATCH || len == limit) break;
+            }
+        }
+        candidate = m->prev[c - m->base];
+    }
+    return best >= DEFLATE_MIN_MATCH ? best : 0;
+}
+
+// Deflates data[start, end), with data[dict, start) as the preset history, into
+// non-final blocks followed by an empty stored block
+static Byte_Buffer deflate_chunk(const unsigned char *data, size_t dict, size_t start, size_t end)
+{
+    Bit_Writer w = {0};
+    Match_Finder m;
+    Deflate_Symbol *symbols = malloc(DEFLATE_BLOCK_SYMBOLS * sizeof(*symbols));
+    size_t symbol_count = 0;
+
+    m.base = dict;
+    m.head = malloc(((size_t)1 << DEFLATE_HASH_BITS) * sizeof(*m.head));
+    m.prev = malloc((end - dict + 1) * sizeof(*m.prev));
+    if (symbols == NULL || m.head == NULL || m.prev == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the deflate state\n");
+        exit(1);
+    }
+    memset(m.head, 0xff, ((size_t)1 << DEFLATE_HASH_BITS) * sizeof(*m.head));
+    byte_buffer_reserve(&w.out, (end - start) / 2 + 64);
+
+    for (size_t pos = dict; pos < start; ++pos) {
+        if (pos + DEFLATE_MIN_MATCH <= end) match_insert(&m, data, pos);
+    }
+
+    size_t pos = start;
+    while (pos < end) {
+        size_t dist = 0, len = 0;
+        if (pos + DEFLATE_MIN_MATCH <= end) {
+            len = match_find(&m, data, pos, end, &dist);
+            match_insert(&m, data, pos);
+        }
+        // one step lazy matching: a longer match right after wins over this one
+        if (len > 0 && len < DEFLATE_GOOD_MATCH && pos + 1 + DEFLATE_MIN_MATCH <= end) {
+            size_t next_dist = 0, next_len = match_find(&m, data, pos + 1, end, &next_dist);
+            if (next_len > len) len = 0;
+        }
+
+        if (len == 0) {
+            symbols[symbol_count++] = (Deflate_Symbol){ data[pos], 0 };
+            pos += 1;
+        } else {
+            symbols[symbol_count++] = (Deflate_Symbol){ (uint16_t)len, (uint16_t)dist };
+            for (size_t i = 1; i < len; ++i) {
+                if (pos + i + DEFLATE_MIN_MATCH <= end) match_insert(&m, data, pos + i);
+            }
+            pos += len;
+        }
+        if (symbol_count == DEFLATE_BLOCK_SYMBOLS) {
+            deflate_write_block(&w, symbols, symbol_count, 0);
+            symbol_count = 0;
+        }
+    }
+    if (symbol_count > 0) deflate_write_block(&w, symbols, symbol_count, 0);
+
+    // empty stored block, the next chunk starts on a byte boundary
+    bits_put(&w, 0, 3);
+    bits_align(&w);
+    static const unsigned char sync[4] = {0x00, 0x00, 0xff, 0xff};
+    byte_buffer_append(&w.out, sync, sizeof(sync));
+
+    free(symbols);
+    free(m.head);
+    free(m.prev);
+    return w.out;
+}
+
+uint32_t deflate_adler32(const unsigned char *data, size_t size)
+{
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t n = size < 5552 ? size : 5552;
+        for (size_t i = 0; i < n; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += n;
+        size -= n;
+    }
+    return b << 16 | a;
+}
+
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    size_t chunk_size;
+    size_t chunk_count;
+    Byte_Buffer *chunks;
+    size_t next;
+    Mutex lock;
+} Deflate_Jobs;
+
+static void *deflate_worker(void *arg)
+{
+    Deflate_Jobs *jobs = arg;
+    for (;;) {
+        mutex_lock(&jobs->lock);
+        size_t chunk = jobs->next++;
+        mutex_unlock(&jobs->lock);
+        if (chunk >= jobs->chunk_count) return NULL;
+
+        size_t start = chunk * jobs->chunk_size;
+        size_t end = start + jobs->chunk_size < jobs->size ? start + jobs->chunk_size : jobs->size;
+        size_t dict = start > DEFLATE_WINDOW ? start - DEFLATE_WINDOW : 0;
+        jobs->chunks[chunk] = deflate_chunk(jobs->data, dict, start, end);
+    }
+}
+
+// Compresses `size` bytes into a zlib stream, `chunk_size` bytes at a time on
+// `thread_count` threads
+Byte_Buffer deflate_compress(const unsigned char *data, size_t size, size_t chunk_size, int thread_count)
+{
+    Byte_Buffer out = {0};
+    Deflate_Jobs jobs = {0};
+
+    deflate_init_tables();
+    jobs.data = data;
+    jobs.size = size;
+    jobs.chunk_size = chunk_size;
+    jobs.chunk_count = (size + chunk_size - 1) / chunk_size;
+    jobs.chunks = calloc(jobs.chunk_count + 1, sizeof(*jobs.chunks));
+    if (jobs.chunks == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the deflate chunks\n");
+        exit(1);
+    }
+    mutex_init(&jobs.lock);
+
+    if (thread_count < 1) thread_count = 1;
+    if ((size_t)thread_count > jobs.chunk_count) thread_count = jobs.chunk_count > 0 ? (int)jobs.chunk_count : 1;
+    Thread *threads = malloc((size_t)thread_count * sizeof(*threads));
+    int started = 1;
+    for (; threads != NULL && started < thread_count; ++started) {
+        if (!thread_create(&threads[started], deflate_worker, &jobs)) break;
+    }
+    deflate_worker(&jobs);
+    for (int i = 1; i < started; ++i) thread_join(threads[i]);
+    free(threads);
+    mutex_destroy(&jobs.lock);
+
+    // zlib header: deflate with a 32K window, default level
+    byte_buffer_push(&out, 0x78);
+    byte_buffer_push(&out, 0x9c);
+    for (size_t i = 0; i < jobs.chunk_count; ++i) {
+        byte_buffer_append(&out, jobs.chunks[i].data, jobs.chunks[i].size);
+        byte_buffer_free(&jobs.chunks[i]);
+    }
+    // final empty block with fixed codes: BFINAL, BTYPE 01 and the 7 bit end of block
+    byte_buffer_push(&out, 0x03);
+    byte_buffer_push(&out, 0x00);
+    uint32_t adler = deflate_adler32(data, size);
+    for (int i = 3; i >= 0; --i) byte_buffer_push(&out, (unsigned char)(adler >> (8 * i)));
+
+    free(jobs.chunks);
+    return out;
+}
+
+// NAME_RAW_SIZE, NAME_ZLIB_SIZE and NAME_UNIT_SIZE for stbi_zlib_decode_buffer()
+void deflate_emit_info(Emitter *out, const char *name, size_t raw_size, size_t zlib_size, size_t unit_size)
+{
+    emitter_printf(out, "size_t %s_RAW_SIZE = %zu;\n", name, raw_size);
+    emitter_printf(out, "size_t %s_ZLIB_SIZE = %zu;\n", name, zlib_size);
+    emitter_printf(out, "size_t %s_UNIT_SIZE = %zu;\n", name, unit_size);
+}
+
+// Inflates the stream back with stb_image, checks it against `raw` and prints the
+// ratio and time next to those of one single threaded stream
+void deflate_report(const char *filepath, const Byte_Buffer *stream, double seconds, int thread_count,
+                    const unsigned char *raw, size_t raw_size)
+{
+    char *decoded = malloc(raw_size + 1);
+    if (decoded == NULL) return;
+
+    int rounds = 0, decoded_size = 0;
+    double start = timer_now(), elapsed = 0.0;
+    do {
+        decoded_size = stbi_zlib_decode_buffer(decoded, (int)raw_size, (const char *)stream->data, (int)stream->size);
+        rounds += 1;
+        elapsed = timer_now() - start;
+    } while (elapsed < 0.05);
+
+    if (decoded_size != (int)raw_size || memcmp(decoded, raw, raw_size) != 0) {
+        fprintf(stderr, "ERROR: %s: zlib stream does not inflate back to the image\n", filepath);
+        exit(1);
+    }
+
+    double single_start = timer_now();
+    Byte_Buffer single = deflate_compress(raw, raw_size, raw_size > 0 ? raw_size : 1, 1);
+    double single_seconds = timer_now() - single_start;
+
+    fprintf(stderr, "%s: zlib %zu -> %zu bytes (%.2fx) in %.1f ms on %d threads, "
+            "single stream %zu bytes (%.2fx) in %.1f ms, inflate %.1f MB/s\n",
+            filepath, raw_size, stream->size, (double)raw_size / (double)stream->size, seconds * 1000.0, thread_count,
+            single.size, (double)raw_size / (double)single.size, single_seconds * 1000.0,
+            timer_mbps(raw_size * (size_t)rounds, elapsed));
+    byte_buffer_free(&single);
+    free(decoded);
+}
+
+#endif // DEFLATE_C_
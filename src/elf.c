@@ -0,0 +1,174 @@
+#ifndef ELF_C_
+#define ELF_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "./emit.c"
+
+// Minimal ELF64 little-endian relocatable object writer. The object has a single
+// .rodata section holding NAME_WIDTH, NAME_HEIGHT (8 bytes each) followed by the
+// pixels, so it links straight into the program without going through a compiler.
+
+#define ELF_HEADER_SIZE  64
+#define ELF_SECTION_SIZE 64
+#define ELF_SYMBOL_SIZE  24
+
+#define ELF_SHT_PROGBITS 1
+#define ELF_SHT_SYMTAB   2
+#define ELF_SHT_STRTAB   3
+#define ELF_SHF_ALLOC    0x2
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define ELF_MACHINE_HOST 183    // EM_AARCH64
+#elif defined(__riscv) && __riscv_xlen == 64
+#define ELF_MACHINE_HOST 243    // EM_RISCV
+#else
+#define ELF_MACHINE_HOST 62     // EM_X86_64
+#endif
+
+// Looks up an e_machine value by name, returns -1 when unknown
+int elf_machine_from_name(const char *name)
+{
+    if (strcmp(name, "x86_64") == 0) return 62;
+    if (strcmp(name, "aarch64") == 0) return 183;
+    if (strcmp(name, "riscv64") == 0) return 243;
+    return -1;
+}
+
+static void elf_put16(unsigned char *p, uint16_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void elf_put32(unsigned char *p, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void elf_put64(unsigned char *p, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void elf_section(unsigned char *p, uint32_t name, uint32_t type, uint64_t flags,
+                        uint64_t offset, uint64_t size, uint32_t link, uint32_t info,
+                        uint64_t align, uint64_t entsize)
+{
+    memset(p, 0, ELF_SECTION_SIZE);
+    elf_put32(p + 0, name);
+    elf_put32(p + 4, type);
+    elf_put64(p + 8, flags);
+    elf_put64(p + 24, offset);
+    elf_put64(p + 32, size);
+    elf_put32(p + 40, link);
+    elf_put32(p + 44, info);
+    elf_put64(p + 48, align);
+    elf_put64(p + 56, entsize);
+}
+
+static void elf_symbol(unsigned char *p, uint32_t name, uint16_t section, uint64_t value, uint64_t size)
+{
+    memset(p, 0, ELF_SYMBOL_SIZE);
+    elf_put32(p + 0, name);
+    p[4] = (1 << 4) | 1;        // STB_GLOBAL, STT_OBJECT
+    p[5] = 0;                   // STV_DEFAULT
+    elf_put16(p + 6, section);
+    elf_put64(p + 8, value);
+    elf_put64(p + 16, size);
+}
+
+static void elf_pad(Emitter *out, size_t offset, size_t align)
+{
+    static const char zeros[16] = {0};
+    size_t padding = (align - offset % align) % align;
+    emitter_write(out, zeros, padding);
+}
+
+// Writes a relocatable object defining `name`, `name`_WIDTH and `name`_HEIGHT
+void elf_emit_object(Emitter *out, const char *name, int machine,
+                     const unsigned char *pixels, size_t pixel_bytes, int width, int height)
+{
+    enum { SEC_NULL, SEC_RODATA, SEC_SYMTAB, SEC_STRTAB, SEC_SHSTRTAB, SEC_NOTE, SEC_COUNT };
+    static const char shstrtab[] = "\0.rodata\0.symtab\0.strtab\0.shstrtab\0.note.GNU-stack";
+    const uint32_t sh_rodata = 1, sh_symtab = 9, sh_strtab = 17, sh_shstrtab = 25, sh_note = 35;
+
+    size_t name_len = strlen(name);
+
+    // .strtab: "\0NAME\0NAME_WIDTH\0NAME_HEIGHT\0"
+    size_t str_name = 1;
+    size_t str_width = str_name + name_len + 1;
+    size_t str_height = str_width + name_len + sizeof("_WIDTH");
+    size_t strtab_size = str_height + name_len + sizeof("_HEIGHT");
+
+    size_t rodata_offset = ELF_HEADER_SIZE;
+    size_t rodata_size = 16 + pixel_bytes;
+    size_t symtab_offset = (rodata_offset + rodata_size + 7) & ~(size_t)7;
+    size_t symtab_size = 4 * ELF_SYMBOL_SIZE;
+    size_t strtab_offset = symtab_offset + symtab_size;
+    size_t shstrtab_offset = strtab_offset + strtab_size;
+    size_t sections_offset = (shstrtab_offset + sizeof(shstrtab) + 7) & ~(size_t)7;
+
+    unsigned char header[ELF_HEADER_SIZE] = {0x7f, 'E', 'L', 'F', 2, 1, 1};     // ELFCLASS64, LSB, EV_CURRENT
+    elf_put16(header + 16, 1);                      // ET_REL
+    elf_put16(header + 18, (uint16_t)machine);
+    elf_put32(header + 20, 1);
+    elf_put64(header + 40, sections_offset);
+    // GNU ld takes an object without float ABI flags for soft-float and will not
+    // link it into lp64d programs, the Linux default
+    if (machine == 243) elf_put32(header + 48, 0x4);   // EF_RISCV_FLOAT_ABI_DOUBLE
+    elf_put16(header + 52, ELF_HEADER_SIZE);
+    elf_put16(header + 58, ELF_SECTION_SIZE);
+    elf_put16(header + 60, SEC_COUNT);
+    elf_put16(header + 62, SEC_SHSTRTAB);
+    emitter_write(out, (const char *)header, sizeof(header));
+
+    unsigned char sizes[16];
+    elf_put64(sizes + 0, (uint64_t)width);
+    elf_put64(sizes + 8, (uint64_t)height);
+    emitter_write(out, (const char *)sizes, sizeof(sizes));
+    emitter_write(out, (const char *)pixels, pixel_bytes);
+    elf_pad(out, rodata_offset + rodata_size, 8);
+
+    unsigned char symbols[4 * ELF_SYMBOL_SIZE] = {0};
+    elf_symbol(symbols + 1 * ELF_SYMBOL_SIZE, (uint32_t)str_name, SEC_RODATA, 16, pixel_bytes);
+    elf_symbol(symbols + 2 * ELF_SYMBOL_SIZE, (uint32_t)str_width, SEC_RODATA, 0, 8);
+    elf_symbol(symbols + 3 * ELF_SYMBOL_SIZE, (uint32_t)str_height, SEC_RODATA, 8, 8);
+    emitter_write(out, (const char *)symbols, sizeof(symbols));
+
+    emitter_write(out, "", 1);
+    emitter_printf(out, "%s", name);
+    emitter_write(out, "", 1);
+    emitter_printf(out, "%s_WIDTH", name);
+    emitter_write(out, "", 1);
+    emitter_printf(out, "%s_HEIGHT", name);
+    emitter_write(out, "", 1);
+
+    emitter_write(out, shstrtab, sizeof(shstrtab));
+    elf_pad(out, shstrtab_offset + sizeof(shstrtab), 8);
+
+    unsigned char sections[SEC_COUNT * ELF_SECTION_SIZE] = {0};
+    elf_section(sections + SEC_RODATA * ELF_SECTION_SIZE, sh_rodata, ELF_SHT_PROGBITS, ELF_SHF_ALLOC,
+                rodata_offset, rodata_size, 0, 0, 16, 0);
+    elf_section(sections + SEC_SYMTAB * ELF_SECTION_SIZE, sh_symtab, ELF_SHT_SYMTAB, 0,
+                symtab_offset, symtab_size, SEC_STRTAB, 1, 8, ELF_SYMBOL_SIZE);
+    elf_section(sections + SEC_STRTAB * ELF_SECTION_SIZE, sh_strtab, ELF_SHT_STRTAB, 0,
+                strtab_offset, strtab_size, 0, 0, 1, 0);
+    elf_section(sections + SEC_SHSTRTAB * ELF_SECTION_SIZE, sh_shstrtab, ELF_SHT_STRTAB, 0,
+                shstrtab_offset, sizeof(shstrtab), 0, 0, 1, 0);
+    elf_section(sections + SEC_NOTE * ELF_SECTION_SIZE, sh_note, ELF_SHT_PROGBITS, 0,
+                sections_offset, 0, 0, 0, 1, 0);
+    emitter_write(out, (const char *)sections, sizeof(sections));
+}
+
+// Declarations matching elf_emit_object()
+void elf_emit_declarations(Emitter *out, const char *name, const char *ctype)
+{
+    emitter_printf(out, "extern const size_t %s_WIDTH;\n", name);
+    emitter_printf(out, "extern const size_t %s_HEIGHT;\n", name);
+    emitter_printf(out, "extern const %s %s[];\n", ctype, name);
+}
+
+#endif // ELF_C_
@@ -0,0 +1,96 @@
+#ifndef EMBED_C_
+#define EMBED_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./emit.c"
+
+// Raw sidecar output: the packed pixels go to a .bin file in the requested byte
+// order and the header only pulls them in, so the compiler never parses a giant
+// initializer list.
+
+// Writes `size` bytes to `path`, returns 0 on failure
+int embed_write_file(const char *path, const void *bytes, size_t size)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open `%s` for writing\n", path);
+        return 0;
+    }
+    int ok = fwrite(bytes, 1, size, f) == size;
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) fprintf(stderr, "ERROR: could not write `%s`\n", path);
+    return ok;
+}
+
+// Reads the whole file at `path`, returns NULL on failure
+unsigned char *embed_read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+
+    unsigned char *bytes = NULL;
+    long end = -1;
+    if (fseek(f, 0, SEEK_END) == 0) end = ftell(f);
+    if (end >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+        bytes = malloc((size_t)end + 1);
+        if (bytes != NULL && fread(bytes, 1, (size_t)end, f) != (size_t)end) {
+            free(bytes);
+            bytes = NULL;
+        }
+    }
+    fclose(f);
+    *size = (size_t)(end >= 0 ? end : 0);
+    return bytes;
+}
+
+// Array that includes `bin_name` with C23 #embed, `ctype` is the pixel type
+void embed_emit_array(Emitter *out, const char *name, const char *ctype, const char *bin_name)
+{
+    emitter_puts(out, "#if defined(__has_embed)\n");
+    emitter_printf(out, "_Alignas(%s) const unsigned char %s_BYTES[] = {\n", ctype, name);
+    emitter_printf(out, "#embed \"%s\"\n", bin_name);
+    emitter_puts(out, "};\n");
+    emitter_printf(out, "#define %s ((const %s *)%s_BYTES)\n", name, ctype, name);
+    emitter_puts(out, "#else\n");
+    emitter_printf(out, "#error \"%s_H_ needs a compiler with C23 #embed, regenerate it with --mode incbin\"\n", name);
+    emitter_puts(out, "#endif\n");
+}
+
+// Declaration of the pixel array defined by the .incbin stub
+void incbin_emit_declaration(Emitter *out, const char *name, const char *ctype)
+{
+    emitter_printf(out, "extern const %s %s[];\n", ctype, name);
+}
+
+// Assembler stub defining `name` with the contents of `bin_name`, meant to be
+// built as a preprocessed .S file by gcc/clang
+void incbin_emit_stub(Emitter *out, const char *name, const char *bin_name)
+{
+    emitter_puts(out, "#if defined(__APPLE__) || (defined(_WIN32) && !defined(_WIN64))\n");
+    emitter_printf(out, "#define %s_SYMBOL _%s\n", name, name);
+    emitter_puts(out, "#else\n");
+    emitter_printf(out, "#define %s_SYMBOL %s\n", name, name);
+    emitter_puts(out, "#endif\n\n");
+
+    emitter_puts(out, "#if defined(__APPLE__)\n");
+    emitter_puts(out, "    .const\n");
+    emitter_puts(out, "#elif defined(_WIN32)\n");
+    emitter_puts(out, "    .section .rdata,\"dr\"\n");
+    emitter_puts(out, "#else\n");
+    emitter_puts(out, "    .section .rodata\n");
+    emitter_printf(out, "    .type %s_SYMBOL, %%object\n", name);
+    emitter_puts(out, "#endif\n");
+    emitter_printf(out, "    .globl %s_SYMBOL\n", name);
+    emitter_puts(out, "    .balign 4\n");
+    emitter_printf(out, "%s_SYMBOL:\n", name);
+    emitter_printf(out, "    .incbin \"%s\"\n", bin_name);
+    emitter_puts(out, "#if defined(__ELF__)\n");
+    emitter_printf(out, "    .size %s_SYMBOL, . - %s_SYMBOL\n", name, name);
+    emitter_puts(out, "    .section .note.GNU-stack,\"\",%progbits\n");
+    emitter_puts(out, "#endif\n");
+}
+
+#endif // EMBED_C_
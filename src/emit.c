@@ -0,0 +1,506 @@
+#ifndef EMIT_C_
+#define EMIT_C_
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./buffer.c"
+#include "./thread.c"
+
+// SIMD kernels for the hex formatter, disable with -DEMIT_NO_SIMD
+#if !defined(EMIT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define EMIT_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(EMIT_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EMIT_AVX2
+#include <immintrin.h>
+#endif
+
+// Size of the output buffer; the whole header is written with a handful of fwrite calls
+#ifndef EMITTER_CAPACITY
+#define EMITTER_CAPACITY (1 << 20)
+#endif
+
+// Longest text a single pixel can produce: "0xffffffff, "
+#define EMIT_HEX_MAX 12
+
+// Pixels formatted per job in emitter_hex_array_jobs()
+#ifndef EMIT_CHUNK_PIXELS
+#define EMIT_CHUNK_PIXELS (256 * 1024)
+#endif
+
+typedef struct {
+    FILE *stream;
+    Byte_Buffer *sink;  // collects the output instead of `stream` when set
+    char *data;
+    size_t count;
+    size_t capacity;
+    size_t total;       // bytes handed to the stream so far
+    size_t writes;      // number of fwrite calls
+} Emitter;
+
+// Two lowercase hex digits for every byte value
+static char emit_hex_table[256][2];
+static int emit_hex_table_ready = 0;
+
+static void emit_init_tables(void)
+{
+    const char *nibbles = "0123456789abcdef";
+
+    if (emit_hex_table_ready) return;
+    for (int i = 0; i < 256; ++i) {
+        emit_hex_table[i][0] = nibbles[i >> 4];
+        emit_hex_table[i][1] = nibbles[i & 0xf];
+    }
+    emit_hex_table_ready = 1;
+}
+
+void emitter_init(Emitter *e, FILE *stream, size_t capacity)
+{
+    emit_init_tables();
+    if (capacity < EMIT_HEX_MAX) capacity = EMIT_HEX_MAX;
+    e->stream = stream;
+    e->sink = NULL;
+    e->data = malloc(capacity);
+    e->count = 0;
+    e->capacity = capacity;
+    e->total = 0;
+    e->writes = 0;
+    if (e->data == NULL) {
+        fprintf(stderr, "ERROR: could not allocate %zu bytes for the output buffer\n", capacity);
+        exit(1);
+    }
+}
+
+// Emitter that appends everything to `sink`, so a batch can write it later
+void emitter_init_buffer(Emitter *e, Byte_Buffer *sink, size_t capacity)
+{
+    emitter_init(e, NULL, capacity);
+    e->sink = sink;
+}
+
+static void emitter_output(Emitter *e, const char *bytes, size_t n)
+{
+    if (e->sink != NULL) {
+        byte_buffer_append(e->sink, bytes, n);
+    } else if (fwrite(bytes, 1, n, e->stream) != n) {
+        fprintf(stderr, "ERROR: could not write output\n");
+        exit(1);
+    }
+}
+
+void emitter_flush(Emitter *e)
+{
+    if (e->count == 0) return;
+    emitter_output(e, e->data, e->count);
+    e->total += e->count;
+    e->writes += 1;
+    e->count = 0;
+}
+
+void emitter_free(Emitter *e)
+{
+    emitter_flush(e);
+    free(e->data);
+    e->data = NULL;
+    e->capacity = 0;
+}
+
+void emitter_write(Emitter *e, const char *bytes, size_t n)
+{
+    while (n > 0) {
+        if (e->count == e->capacity) emitter_flush(e);
+        size_t room = e->capacity - e->count;
+        size_t chunk = n < room ? n : room;
+        memcpy(e->data + e->count, bytes, chunk);
+        e->count += chunk;
+        bytes += chunk;
+        n -= chunk;
+    }
+}
+
+void emitter_puts(Emitter *e, const char *text)
+{
+    emitter_write(e, text, strlen(text));
+}
+
+// Only meant for the short header lines, the pixel data never goes through here
+void emitter_printf(Emitter *e, const char *fmt, ...)
+{
+    char line[1024];
+    va_list args;
+
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    if (n < 0) return;
+    if ((size_t)n >= sizeof(line)) n = sizeof(line) - 1;
+    emitter_write(e, line, (size_t)n);
+}
+
+// Include guard every generated header starts with
+void emitter_header_begin(Emitter *e, const char *name)
+{
+    emitter_printf(e, "#ifndef %s_H_\n", name);
+    emitter_printf(e, "#define %s_H_\n", name);
+}
+
+void emitter_header_end(Emitter *e, const char *name)
+{
+    emitter_printf(e, "#endif // %s_H_\n", name);
+}
+
+// NAME_WIDTH and NAME_HEIGHT definitions
+void emitter_header_size(Emitter *e, const char *name, int width, int height)
+{
+    emitter_printf(e, "size_t %s_WIDTH = %d;\n", name, width);
+    emitter_printf(e, "size_t %s_HEIGHT = %d;\n", name, height);
+}
+
+// Number of hex digits printf("%x") would use for `value`
+static inline int emit_hex_digits(uint32_t value)
+{
+    if (value == 0) return 1;
+#if defined(__GNUC__)
+    return (32 - __builtin_clz(value) + 3) / 4;
+#else
+    int digits = 8;
+    while ((value >> 28) == 0) {
+        value <<= 4;
+        digits -= 1;
+    }
+    return digits;
+#endif
+}
+
+// Formats one pixel exactly like printf("0x%x, ", value), returns the new end of `out`
+static inline char *emit_hex_u32(char *out, uint32_t value)
+{
+    char digits[8];
+    int n = emit_hex_digits(value);
+
+    memcpy(digits + 0, emit_hex_table[(value >> 24) & 0xff], 2);
+    memcpy(digits + 2, emit_hex_table[(value >> 16) & 0xff], 2);
+    memcpy(digits + 4, emit_hex_table[(value >>  8) & 0xff], 2);
+    memcpy(digits + 6, emit_hex_table[(value >>  0) & 0xff], 2);
+
+    out[0] = '0';
+    out[1] = 'x';
+    memcpy(out + 2, digits + 8 - n, n);
+    out += 2 + n;
+    out[0] = ',';
+    out[1] = ' ';
+    return out + 2;
+}
+
+static char *emit_hex_scalar(char *out, const uint32_t *pixels, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out = emit_hex_u32(out, pixels[i]);
+    }
+    return out;
+}
+
+// The vector kernels always produce the full 8 digits, so they only take groups of
+// pixels whose top nibble is set; anything else goes through emit_hex_u32 so the
+// text stays identical to printf("0x%x, ").
+#ifdef EMIT_SSE2
+static char *emit_hex_sse2(char *out, const uint32_t *pixels, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i ascii_digit = _mm_set1_epi8('0');
+    const __m128i ascii_alpha = _mm_set1_epi8('a' - '0' - 10);
+    const __m128i template0 = _mm_setr_epi8('0', 'x', 0, 0, 0, 0, 0, 0, 0, 0, ',', ' ', '0', 'x', 0, 0);
+    const __m128i template1 = _mm_setr_epi8(0, 0, 0, 0, 0, 0, ',', ' ', '0', 'x', 0, 0, 0, 0, 0, 0);
+    const __m128i template2 = _mm_setr_epi8(0, 0, ',', ' ', '0', 'x', 0, 0, 0, 0, 0, 0, 0, 0, ',', ' ');
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(pixels + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_srli_epi32(v, 28), zero)) != 0) {
+            out = emit_hex_scalar(out, pixels + i, 4);
+            continue;
+        }
+
+        // byte swap every word so the most significant byte comes first
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflelo_epi16(_mm_shufflehi_epi16(v, 0xb1), 0xb1);
+
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+        __m128i lo = _mm_and_si128(v, mask);
+        __m128i d01 = _mm_unpacklo_epi8(hi, lo);
+        __m128i d23 = _mm_unpackhi_epi8(hi, lo);
+        d01 = _mm_add_epi8(_mm_add_epi8(d01, ascii_digit), _mm_and_si128(_mm_cmpgt_epi8(d01, nine), ascii_alpha));
+        d23 = _mm_add_epi8(_mm_add_epi8(d23, ascii_digit), _mm_and_si128(_mm_cmpgt_epi8(d23, nine), ascii_alpha));
+
+        _mm_storeu_si128((__m128i *)(out +  0), template0);
+        _mm_storeu_si128((__m128i *)(out + 16), template1);
+        _mm_storeu_si128((__m128i *)(out + 32), template2);
+        _mm_storel_epi64((__m128i *)(out +  2), d01);
+        _mm_storel_epi64((__m128i *)(out + 14), _mm_unpackhi_epi64(d01, d01));
+        _mm_storel_epi64((__m128i *)(out + 26), d23);
+        _mm_storel_epi64((__m128i *)(out + 38), _mm_unpackhi_epi64(d23, d23));
+        out += 4 * EMIT_HEX_MAX;
+    }
+
+    return emit_hex_scalar(out, pixels + i, count - i);
+}
+#endif
+
+#ifdef EMIT_AVX2
+__attribute__((target("avx2")))
+static char *emit_hex_avx2(char *out, const uint32_t *pixels, size_t count)
+{
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    const __m256i lut = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+                                         '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    // Per lane, A holds the unpacked nibbles of pixels 0-1 and B of pixels 2-3 as
+    // [hi(b0) lo(b0) hi(b1) lo(b1) ...]. The shuffles below reverse the bytes of every
+    // pixel and place its 8 digits into 12 byte "0x________, " slots.
+#define EMIT_LANES(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+    const __m256i shuf0a = EMIT_LANES(-1, -1, 6, 7, 4, 5, 2, 3, 0, 1, -1, -1, -1, -1, 14, 15);
+    const __m256i shuf1a = EMIT_LANES(12, 13, 10, 11, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i shuf1b = EMIT_LANES(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 6, 7, 4, 5, 2, 3);
+    const __m256i shuf2b = EMIT_LANES(0, 1, -1, -1, -1, -1, 14, 15, 12, 13, 10, 11, 8, 9, -1, -1);
+    const __m256i template0 = EMIT_LANES('0', 'x', 0, 0, 0, 0, 0, 0, 0, 0, ',', ' ', '0', 'x', 0, 0);
+    const __m256i template1 = EMIT_LANES(0, 0, 0, 0, 0, 0, ',', ' ', '0', 'x', 0, 0, 0, 0, 0, 0);
+    const __m256i template2 = EMIT_LANES(0, 0, ',', ' ', '0', 'x', 0, 0, 0, 0, 0, 0, 0, 0, ',', ' ');
+#undef EMIT_LANES
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(pixels + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_srli_epi32(v, 28), _mm256_setzero_si256())) != 0) {
+            out = emit_hex_scalar(out, pixels + i, 8);
+            continue;
+        }
+
+        __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+        __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, mask));
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);
+
+        __m256i out0 = _mm256_or_si256(_mm256_shuffle_epi8(a, shuf0a), template0);
+        __m256i out1 = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, shuf1a),
+                                                       _mm256_shuffle_epi8(b, shuf1b)), template1);
+        __m256i out2 = _mm256_or_si256(_mm256_shuffle_epi8(b, shuf2b), template2);
+
+        _mm256_storeu_si256((__m256i *)(out +  0), _mm256_permute2x128_si256(out0, out1, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 32), _mm256_permute2x128_si256(out2, out0, 0x30));
+        _mm256_storeu_si256((__m256i *)(out + 64), _mm256_permute2x128_si256(out1, out2, 0x31));
+        out += 8 * EMIT_HEX_MAX;
+    }
+
+    return emit_hex_sse2(out, pixels + i, count - i);
+}
+#endif
+
+typedef enum {
+    EMIT_KERNEL_SCALAR = 0,
+    EMIT_KERNEL_SSE2,
+    EMIT_KERNEL_AVX2,
+} Emit_Kernel;
+
+static const char *emit_kernel_names[] = { "scalar", "sse2", "avx2" };
+
+// Best kernel the CPU supports, lowered by emit_set_kernel()
+static int emit_kernel = -1;
+
+static int emit_detect_kernel(void)
+{
+#ifdef EMIT_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return EMIT_KERNEL_AVX2;
+#endif
+#ifdef EMIT_SSE2
+    return EMIT_KERNEL_SSE2;
+#else
+    return EMIT_KERNEL_SCALAR;
+#endif
+}
+
+// Caps the kernel used by the hex formatter, returns the one that will run
+Emit_Kernel emit_set_kernel(Emit_Kernel limit)
+{
+    int best = emit_detect_kernel();
+    emit_kernel = (int)limit < best ? (int)limit : best;
+    return (Emit_Kernel)emit_kernel;
+}
+
+const char *emit_kernel_name(void)
+{
+    if (emit_kernel < 0) emit_kernel = emit_detect_kernel();
+    return emit_kernel_names[emit_kernel];
+}
+
+// Formats `count` pixels into `out` with the selected kernel, `out` needs
+// room for count * EMIT_HEX_MAX bytes
+static char *emit_hex_block(char *out, const uint32_t *pixels, size_t count)
+{
+    if (emit_kernel < 0) emit_kernel = emit_detect_kernel();
+    switch (emit_kernel) {
+#ifdef EMIT_AVX2
+    case EMIT_KERNEL_AVX2: return emit_hex_avx2(out, pixels, count);
+#endif
+#ifdef EMIT_SSE2
+    case EMIT_KERNEL_SSE2: return emit_hex_sse2(out, pixels, count);
+#endif
+    default: return emit_hex_scalar(out, pixels, count);
+    }
+}
+
+// Writes `count` pixels as "0x%x, " entries
+void emitter_hex_array(Emitter *e, const uint32_t *pixels, size_t count)
+{
+    while (count > 0) {
+        size_t room = (e->capacity - e->count) / EMIT_HEX_MAX;
+        if (room == 0) {
+            emitter_flush(e);
+            continue;
+        }
+        size_t batch = count < room ? count : room;
+        char *out = emit_hex_block(e->data + e->count, pixels, batch);
+        e->count = (size_t)(out - e->data);
+        pixels += batch;
+        count -= batch;
+    }
+}
+
+// Hands an already formatted block straight to the stream, keeping the order of
+// whatever is buffered in front of it
+static void emitter_write_block(Emitter *e, const char *bytes, size_t n)
+{
+    emitter_flush(e);
+    if (n == 0) return;
+    emitter_output(e, bytes, n);
+    e->total += n;
+    e->writes += 1;
+}
+
+// Chunks are claimed by the workers in order and land in a ring of slots; a worker
+// can run at most `slot_count` chunks ahead of the writer so memory stays bounded.
+typedef struct {
+    const uint32_t *pixels;
+    size_t count;
+    size_t chunk_count;
+    size_t slot_count;
+    char **slot_data;
+    size_t *slot_size;
+    size_t *slot_chunk;     // chunk currently finished in each slot, (size_t)-1 when empty
+    size_t next;            // next chunk to format
+    size_t written;         // chunks written so far
+    Mutex lock;
+    Cond changed;
+} Emit_Jobs;
+
+static void *emit_jobs_worker(void *arg)
+{
+    Emit_Jobs *jobs = arg;
+
+    for (;;) {
+        mutex_lock(&jobs->lock);
+        while (jobs->next < jobs->chunk_count && jobs->next >= jobs->written + jobs->slot_count) {
+            cond_wait(&jobs->changed, &jobs->lock);
+        }
+        if (jobs->next >= jobs->chunk_count) {
+            mutex_unlock(&jobs->lock);
+            return NULL;
+        }
+        size_t chunk = jobs->next++;
+        mutex_unlock(&jobs->lock);
+
+        size_t slot = chunk % jobs->slot_count;
+        size_t first = chunk * EMIT_CHUNK_PIXELS;
+        size_t n = jobs->count - first < EMIT_CHUNK_PIXELS ? jobs->count - first : EMIT_CHUNK_PIXELS;
+        char *end = emit_hex_block(jobs->slot_data[slot], jobs->pixels + first, n);
+
+        mutex_lock(&jobs->lock);
+        jobs->slot_size[slot] = (size_t)(end - jobs->slot_data[slot]);
+        jobs->slot_chunk[slot] = chunk;
+        cond_broadcast(&jobs->changed);
+        mutex_unlock(&jobs->lock);
+    }
+}
+
+// Same output as emitter_hex_array(), formatted by `thread_count` workers while
+// the calling thread writes the finished chunks in order
+void emitter_hex_array_jobs(Emitter *e, const uint32_t *pixels, size_t count, int thread_count)
+{
+    Emit_Jobs jobs = {0};
+    Thread *threads;
+
+    jobs.chunk_count = (count + EMIT_CHUNK_PIXELS - 1) / EMIT_CHUNK_PIXELS;
+    if (thread_count <= 1 || jobs.chunk_count <= 1) {
+        emitter_hex_array(e, pixels, count);
+        return;
+    }
+    if ((size_t)thread_count > jobs.chunk_count) thread_count = (int)jobs.chunk_count;
+
+    if (emit_kernel < 0) emit_kernel = emit_detect_kernel();
+    jobs.pixels = pixels;
+    jobs.count = count;
+    jobs.slot_count = 2 * (size_t)thread_count;
+    jobs.slot_data = malloc(jobs.slot_count * sizeof(*jobs.slot_data));
+    jobs.slot_size = malloc(jobs.slot_count * sizeof(*jobs.slot_size));
+    jobs.slot_chunk = malloc(jobs.slot_count * sizeof(*jobs.slot_chunk));
+    threads = malloc((size_t)thread_count * sizeof(*threads));
+    if (!jobs.slot_data || !jobs.slot_size || !jobs.slot_chunk || !threads) {
+        fprintf(stderr, "ERROR: could not allocate formatting jobs\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < jobs.slot_count; ++i) {
+        jobs.slot_data[i] = malloc(EMIT_CHUNK_PIXELS * EMIT_HEX_MAX);
+        jobs.slot_chunk[i] = (size_t)-1;
+        if (jobs.slot_data[i] == NULL) {
+            fprintf(stderr, "ERROR: could not allocate formatting jobs\n");
+            exit(1);
+        }
+    }
+    mutex_init(&jobs.lock);
+    cond_init(&jobs.changed);
+
+    int started = 0;
+    for (; started < thread_count; ++started) {
+        if (!thread_create(&threads[started], emit_jobs_worker, &jobs)) break;
+    }
+    if (started == 0) {
+        // no threads available, format everything on this one; a worker here
+        // would stop once the slots are full since nothing writes them out
+        emitter_hex_array(e, pixels, count);
+    }
+
+    for (size_t chunk = 0; started > 0 && chunk < jobs.chunk_count; ++chunk) {
+        size_t slot = chunk % jobs.slot_count;
+
+        mutex_lock(&jobs.lock);
+        while (jobs.slot_chunk[slot] != chunk) cond_wait(&jobs.changed, &jobs.lock);
+        mutex_unlock(&jobs.lock);
+
+        emitter_write_block(e, jobs.slot_data[slot], jobs.slot_size[slot]);
+
+        mutex_lock(&jobs.lock);
+        jobs.written += 1;
+        cond_broadcast(&jobs.changed);
+        mutex_unlock(&jobs.lock);
+    }
+
+    for (int i = 0; i < started; ++i) thread_join(threads[i]);
+
+    cond_destroy(&jobs.changed);
+    mutex_destroy(&jobs.lock);
+    for (size_t i = 0; i < jobs.slot_count; ++i) free(jobs.slot_data[i]);
+    free(jobs.slot_data);
+    free(jobs.slot_size);
+    free(jobs.slot_chunk);
+    free(threads);
+}
+
+#endif // EMIT_C_
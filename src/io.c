@@ -0,0 +1,423 @@
+#ifndef IO_C_
+#define IO_C_
+
+// syscall(), has to come before the first system header to take effect
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./embed.c"
+
+// Batched whole-file reads and writes for batch mode, counting the system calls
+// they take. The POSIX backend opens, sizes, reads and closes one file after the
+// other. The io_uring backend (Linux, raw syscalls, no liburing) submits the opens
+// of a whole batch with one io_uring_enter() and the reads or writes, each linked
+// to its close, with a second one, so a batch costs two syscalls however many
+// files it has. Build with -DIO_NO_URING to leave it out.
+//
+// Single images are opened with io_input_open(), which maps regular files so stb
+// decodes them in place, and reads pipes and other streams into memory with large
+// read() calls rather than through stdio.
+
+#if defined(__linux__) && !defined(IO_NO_URING) && defined(__GNUC__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define IO_URING
+#endif
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef IO_URING
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+// Files per io_uring batch, every file takes two submission entries
+#define IO_BATCH_FILES 64
+
+// Bytes per read() when an input cannot be mapped
+#define IO_READ_CHUNK ((size_t)1 << 20)
+
+typedef enum {
+    IO_POSIX = 0,
+    IO_URING_BACKEND,
+} Io_Backend;
+
+typedef struct {
+    const char *path;
+    unsigned char *data;    // read: allocated here; write: the bytes to store
+    size_t size;            // read: expected size in, actual size out
+    int ok;
+} Io_Request;
+
+typedef struct {
+    Io_Backend backend;
+    size_t syscalls;
+#ifdef IO_URING
+    int ring;
+    unsigned char *sq_map, *cq_map;
+    size_t sq_map_size, cq_map_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned queued;        // entries written but not submitted yet
+#endif
+} Io;
+
+// The whole contents of one input file
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    int mapped;             // data is a read-only mapping of the file
+    size_t reads;           // read() calls it took, 0 when mapped
+} Io_Input;
+
+#ifndef _WIN32
+static int io_posix_read(Io *io, Io_Request *r)
+{
+    int fd = open(r->path, O_RDONLY | O_CLOEXEC);
+    io->syscalls += 1;
+    if (fd < 0) return 0;
+
+    struct stat st;
+    io->syscalls += 1;
+    int ok = fstat(fd, &st) == 0;
+    size_t size = ok ? (size_t)st.st_size : 0, done = 0;
+    r->data = ok ? malloc(size + 1) : NULL;
+    while (r->data != NULL && done < size) {
+        ssize_t n = read(fd, r->data + done, size - done);
+        io->syscalls += 1;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    close(fd);
+    io->syscalls += 1;
+    r->size = done;
+    return r->data != NULL && done == size;
+}
+
+static int io_posix_write(Io *io, Io_Request *r)
+{
+    int fd = open(r->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    io->syscalls += 1;
+    if (fd < 0) return 0;
+
+    size_t done = 0;
+    while (done < r->size) {
+        ssize_t n = write(fd, r->data + done, r->size - done);
+        io->syscalls += 1;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    io->syscalls += 1;
+    int ok = close(fd) == 0 && done == r->size;
+    return ok;
+}
+#else
+static int io_posix_read(Io *io, Io_Request *r)
+{
+    io->syscalls += 1;
+    r->data = embed_read_file(r->path, &r->size);
+    return r->data != NULL;
+}
+
+static int io_posix_write(Io *io, Io_Request *r)
+{
+    io->syscalls += 1;
+    return embed_write_file(r->path, r->data, r->size);
+}
+#endif
+
+#ifdef IO_URING
+static int io_uring_start(Io *io, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    io->syscalls += 1;
+    io->ring = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (io->ring < 0) return 0;
+
+    io->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    io->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && io->cq_map_size > io->sq_map_size) io->sq_map_size = io->cq_map_size;
+
+    io->syscalls += 1;
+    io->sq_map = mmap(NULL, io->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, io->ring, IORING_OFF_SQ_RING);
+    if (io->sq_map == MAP_FAILED) return 0;
+    if (single) {
+        io->cq_map = io->sq_map;
+    } else {
+        io->syscalls += 1;
+        io->cq_map = mmap(NULL, io->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, io->ring, IORING_OFF_CQ_RING);
+        if (io->cq_map == MAP_FAILED) return 0;
+    }
+    io->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    io->syscalls += 1;
+    io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, io->ring, IORING_OFF_SQES);
+    if (io->sqes == MAP_FAILED) return 0;
+
+    io->sq_head = (unsigned *)(io->sq_map + params.sq_off.head);
+    io->sq_tail = (unsigned *)(io->sq_map + params.sq_off.tail);
+    io->sq_mask = (unsigned *)(io->sq_map + params.sq_off.ring_mask);
+    io->sq_array = (unsigned *)(io->sq_map + params.sq_off.array);
+    io->cq_head = (unsigned *)(io->cq_map + params.cq_off.head);
+    io->cq_tail = (unsigned *)(io->cq_map + params.cq_off.tail);
+    io->cq_mask = (unsigned *)(io->cq_map + params.cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe *)(io->cq_map + params.cq_off.cqes);
+    io->sq_entries = params.sq_entries;
+    return 1;
+}
+
+static void io_uring_stop(Io *io)
+{
+    if (io->sqes != NULL && io->sqes != MAP_FAILED) munmap(io->sqes, io->sqes_size);
+    if (io->cq_map != NULL && io->cq_map != MAP_FAILED && io->cq_map != io->sq_map) munmap(io->cq_map, io->cq_map_size);
+    if (io->sq_map != NULL && io->sq_map != MAP_FAILED) munmap(io->sq_map, io->sq_map_size);
+    if (io->ring >= 0) close(io->ring);
+}
+
+static struct io_uring_sqe *io_uring_entry(Io *io, int opcode, int fd, uint64_t user_data)
+{
+    unsigned tail = *io->sq_tail + io->queued;
+    unsigned index = tail & *io->sq_mask;
+    struct io_uring_sqe *sqe = &io->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (uint8_t)opcode;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    io->sq_array[index] = index;
+    io->queued += 1;
+    return sqe;
+}
+
+// Submits the queued entries and waits for all of their completions, `result`
+// gets every completion's res by user_data
+static void io_uring_submit_wait(Io *io, int *result)
+{
+    unsigned count = io->queued;
+    __atomic_store_n(io->sq_tail, *io->sq_tail + count, __ATOMIC_RELEASE);
+    io->queued = 0;
+
+    unsigned done = 0, unsubmitted = count;
+    while (done < count) {
+        unsigned head = *io->cq_head, tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail || unsubmitted > 0) {
+            io->syscalls += 1;
+            int submitted = (int)syscall(__NR_io_uring_enter, io->ring, unsubmitted, count - done,
+                                         IORING_ENTER_GETEVENTS, NULL, 0);
+            if (submitted < 0 && errno != EINTR) {
+                fprintf(stderr, "ERROR: io_uring_enter failed\n");
+                exit(1);
+            }
+            if (submitted > 0) unsubmitted -= (unsigned)submitted;
+            continue;
+        }
+        for (; head != tail; ++head) {
+            struct io_uring_cqe *cqe = &io->cqes[head & *io->cq_mask];
+            result[cqe->user_data] = cqe->res;
+            done += 1;
+        }
+        __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+// Opens every file of the batch, then runs one read or write linked to a close
+// per opened file; anything that comes up short goes through the POSIX path
+static void io_uring_batch(Io *io, Io_Request *requests, size_t count, int writing)
+{
+    int fds[IO_BATCH_FILES], result[2 * IO_BATCH_FILES];
+    int flags = writing ? O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC : O_RDONLY | O_CLOEXEC;
+
+    for (size_t i = 0; i < count; ++i) {
+        struct io_uring_sqe *sqe = io_uring_entry(io, IORING_OP_OPENAT, AT_FDCWD, i);
+        sqe->addr = (uint64_t)(uintptr_t)requests[i].path;
+        sqe->open_flags = (uint32_t)flags;
+        sqe->len = 0644;
+    }
+    io_uring_submit_wait(io, result);
+    for (size_t i = 0; i < count; ++i) fds[i] = result[i];
+
+    for (size_t i = 0; i < count; ++i) {
+        Io_Request *r = &requests[i];
+        if (fds[i] < 0) continue;
+        if (!writing) r->data = malloc(r->size + 1);
+        struct io_uring_sqe *sqe = io_uring_entry(io, writing ? IORING_OP_WRITE : IORING_OP_READ, fds[i], 2 * i);
+        sqe->addr = (uint64_t)(uintptr_t)r->data;
+        // one byte more than expected shows when a file grew since it was sized,
+        // so a read comes up short as a rule; a hard link keeps the close
+        // running after it instead of cancelling it
+        sqe->len = (uint32_t)(writing ? r->size : r->size + 1);
+        sqe->flags = IOSQE_IO_HARDLINK;
+        io_uring_entry(io, IORING_OP_CLOSE, fds[i], 2 * i + 1);
+    }
+    io_uring_submit_wait(io, result);
+
+    for (size_t i = 0; i < count; ++i) {
+        Io_Request *r = &requests[i];
+        if (fds[i] < 0) {
+            r->ok = writing ? io_posix_write(io, r) : io_posix_read(io, r);
+            continue;
+        }
+        // only when the ring could not run the close at all
+        if (result[2 * i + 1] == -ECANCELED) {
+            close(fds[i]);
+            io->syscalls += 1;
+        }
+        int n = result[2 * i];
+        if (writing) {
+            r->ok = n >= 0 && (size_t)n == r->size;
+            if (!r->ok) r->ok = io_posix_write(io, r);
+        } else if (n >= 0 && (size_t)n == r->size && r->data != NULL) {
+            r->ok = 1;
+        } else {
+            free(r->data);
+            r->data = NULL;
+            r->ok = io_posix_read(io, r);
+        }
+    }
+}
+#endif
+
+// Sets up `backend`, falls back to POSIX when it is not available; returns the
+// backend in use
+Io_Backend io_init(Io *io, Io_Backend backend)
+{
+    memset(io, 0, sizeof(*io));
+    io->backend = IO_POSIX;
+#ifdef IO_URING
+    io->ring = -1;
+    if (backend == IO_URING_BACKEND) {
+        if (io_uring_start(io, 2 * IO_BATCH_FILES)) {
+            io->backend = IO_URING_BACKEND;
+        } else {
+            io_uring_stop(io);
+            io->ring = -1;
+        }
+    }
+#else
+    (void)backend;
+#endif
+    return io->backend;
+}
+
+void io_free(Io *io)
+{
+#ifdef IO_URING
+    if (io->backend == IO_URING_BACKEND) io_uring_stop(io);
+#endif
+    io->backend = IO_POSIX;
+}
+
+static void io_batch(Io *io, Io_Request *requests, size_t count, int writing)
+{
+#ifdef IO_URING
+    if (io->backend == IO_URING_BACKEND) {
+        for (size_t start = 0; start < count; start += IO_BATCH_FILES) {
+            size_t n = count - start < IO_BATCH_FILES ? count - start : IO_BATCH_FILES;
+            io_uring_batch(io, requests + start, n, writing);
+        }
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; ++i) {
+        requests[i].ok = writing ? io_posix_write(io, &requests[i]) : io_posix_read(io, &requests[i]);
+    }
+}
+
+// Reads every requested file into a malloc'ed buffer; `size` is the expected size
+// going in and the bytes read coming out
+void io_read_batch(Io *io, Io_Request *requests, size_t count)
+{
+    io_batch(io, requests, count, 0);
+}
+
+// Creates or truncates every requested file and writes its bytes
+void io_write_batch(Io *io, Io_Request *requests, size_t count)
+{
+    io_batch(io, requests, count, 1);
+}
+
+#ifndef _WIN32
+// Reads `fd` to the end in reads of `chunk` bytes
+static int io_input_read(Io_Input *in, int fd, size_t chunk)
+{
+    size_t capacity = 0;
+    for (;;) {
+        if (capacity - in->size < chunk) {
+            capacity = capacity * 2 > in->size + chunk ? capacity * 2 : in->size + chunk;
+            unsigned char *data = realloc(in->data, capacity + 1);
+            if (data == NULL) return 0;
+            in->data = data;
+        }
+        ssize_t n = read(fd, in->data + in->size, chunk);
+        in->reads += 1;
+        if (n < 0) return 0;
+        if (n == 0) return 1;
+        in->size += (size_t)n;
+    }
+}
+#endif
+
+void io_input_close(Io_Input *in)
+{
+#ifndef _WIN32
+    if (in->mapped) munmap(in->data, in->size);
+    else free(in->data);
+#else
+    free(in->data);
+#endif
+    memset(in, 0, sizeof(*in));
+}
+
+// Maps the file at `path` when it is a regular file and reads it in reads of
+// `chunk` bytes otherwise; returns 0 when it cannot be read
+int io_input_open(Io_Input *in, const char *path, size_t chunk)
+{
+    memset(in, 0, sizeof(*in));
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    int ok = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            in->data = map;
+            in->size = (size_t)st.st_size;
+            in->mapped = ok = 1;
+        }
+    }
+    if (!in->mapped) ok = io_input_read(in, fd, chunk > 0 ? chunk : IO_READ_CHUNK);
+    close(fd);
+    if (!ok) io_input_close(in);
+    return ok;
+#else
+    (void)chunk;
+    in->reads = 1;
+    in->data = embed_read_file(path, &in->size);
+    return in->data != NULL;
+#endif
+}
+
+const char *io_backend_name(Io_Backend backend)
+{
+    return backend == IO_URING_BACKEND ? "io_uring" : "posix";
+}
+
+#endif // IO_C_
@@ -0,0 +1,81 @@
+#ifndef LAZY_C_
+#define LAZY_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./embed.c"
+#include "./emit.c"
+#include "./timer.c"
+#include "./stb_image.h"
+
+// `--decode lazy`: instead of the decoded pixels the header embeds the input file
+// as it is and an accessor that decodes it on first use, see runtime/image2c_lazy.h.
+// A JPEG photo is often 5-20 times smaller than its RGBA8 pixels.
+
+// Name of the STBI_ONLY_* macro that decodes `bytes`, guessed from its signature
+const char *lazy_stbi_format(const unsigned char *bytes, size_t size)
+{
+    static const struct { const char *magic; size_t len; const char *format; } formats[] = {
+        { "\x89PNG\r\n\x1a\n", 8, "PNG" },
+        { "\xff\xd8\xff", 3, "JPEG" },
+        { "qoif", 4, "QOI" },
+        { "GIF8", 4, "GIF" },
+        { "BM", 2, "BMP" },
+        { "8BPS", 4, "PSD" },
+        { "#?RADIANCE\n", 11, "HDR" },
+        { "#?RGBE\n", 7, "HDR" },
+        { "\x53\x80\xf6\x34", 4, "PIC" },
+        { "P5", 2, "PNM" },
+        { "P6", 2, "PNM" },
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+        if (size >= formats[i].len && memcmp(bytes, formats[i].magic, formats[i].len) == 0) return formats[i].format;
+    }
+    // TGA has no signature
+    return "TGA";
+}
+
+// Size of the embedded file
+void lazy_emit_info(Emitter *out, const char *name, size_t file_size)
+{
+    emitter_printf(out, "size_t %s_FILE_SIZE = %zu;\n", name, file_size);
+}
+
+// NAME_PIXELS(), emitted after the NAME[] array it decodes
+void lazy_emit_accessor(Emitter *out, const char *name, const char *stbi_format)
+{
+    emitter_puts(out, "#include \"image2c_lazy.h\"\n");
+    emitter_printf(out, "static image2c_lazy %s_LAZY;\n", name);
+    emitter_printf(out, "// RGBA8888 pixels, decoded on the first call; needs stb_image with STBI_ONLY_%s\n", stbi_format);
+    emitter_printf(out, "static inline const uint32_t *%s_PIXELS(void)\n", name);
+    emitter_puts(out, "{\n");
+    emitter_printf(out, "    return image2c_lazy_pixels(&%s_LAZY, %s, %s_FILE_SIZE);\n", name, name, name);
+    emitter_puts(out, "}\n");
+}
+
+// Decodes the embedded file the way the accessor will, checks it against `rgba` and
+// prints the size saved and what the first call costs
+void lazy_report(const char *filepath, const unsigned char *file, size_t file_size,
+                 const unsigned char *rgba, int width, int height)
+{
+    size_t raw_size = (size_t)width * (size_t)height * 4;
+    int w = 0, h = 0, channels;
+
+    double start = timer_now();
+    unsigned char *decoded = stbi_load_from_memory(file, (int)file_size, &w, &h, &channels, 4);
+    double seconds = timer_now() - start;
+
+    if (decoded == NULL || w != width || h != height || memcmp(decoded, rgba, raw_size) != 0) {
+        fprintf(stderr, "ERROR: %s: embedded file does not decode back to the pixels\n", filepath);
+        exit(1);
+    }
+    fprintf(stderr, "%s: lazy %zu bytes embedded instead of %zu (%.2fx smaller), first use decodes in %.1f ms (%.1f MB/s)\n",
+            filepath, file_size, raw_size, (double)raw_size / (double)file_size, seconds * 1000.0,
+            timer_mbps(raw_size, seconds));
+    stbi_image_free(decoded);
+}
+
+#endif // LAZY_C_
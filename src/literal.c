@@ -0,0 +1,122 @@
+#ifndef LITERAL_C_
+#define LITERAL_C_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "./emit.c"
+
+// Compact byte array output. Compilers parse one long string literal far faster
+// than an initializer list, and a bare decimal byte list is the smallest list form.
+
+// Bytes per string literal line, adjacent literals are concatenated by the compiler
+#define LITERAL_LINE_BYTES 4096
+
+// Shortest spelling of every byte inside a string literal, and the 3 digit octal
+// form for when the next character is an octal digit and would extend the escape
+static char literal_string_table[256][4];
+static unsigned char literal_string_len[256];
+static char literal_octal_table[256][4];
+// Decimal spelling of every byte
+static char literal_decimal_table[256][4];
+static unsigned char literal_decimal_len[256];
+static int literal_tables_ready = 0;
+
+static void literal_init_tables(void)
+{
+    if (literal_tables_ready) return;
+    for (int b = 0; b < 256; ++b) {
+        char *s = literal_string_table[b];
+        if (b >= 0x20 && b < 0x7f && b != '"' && b != '\\' && b != '?') {
+            s[0] = (char)b;
+            literal_string_len[b] = 1;
+        } else if (b < 010) {
+            s[0] = '\\'; s[1] = (char)('0' + b);
+            literal_string_len[b] = 2;
+        } else if (b < 0100) {
+            s[0] = '\\'; s[1] = (char)('0' + (b >> 3)); s[2] = (char)('0' + (b & 7));
+            literal_string_len[b] = 3;
+        } else {
+            s[0] = '\\'; s[1] = (char)('0' + (b >> 6)); s[2] = (char)('0' + ((b >> 3) & 7)); s[3] = (char)('0' + (b & 7));
+            literal_string_len[b] = 4;
+        }
+
+        char *o = literal_octal_table[b];
+        o[0] = '\\'; o[1] = (char)('0' + (b >> 6)); o[2] = (char)('0' + ((b >> 3) & 7)); o[3] = (char)('0' + (b & 7));
+
+        int n = snprintf(literal_decimal_table[b], 4, "%d", b);
+        literal_decimal_len[b] = (unsigned char)n;
+    }
+    literal_tables_ready = 1;
+}
+
+// Writes `size` bytes as consecutive "..." lines
+void literal_emit_string(Emitter *out, const unsigned char *bytes, size_t size)
+{
+    // worst case per line: quotes, newline and 4 characters per byte
+    char line[LITERAL_LINE_BYTES * 4 + 4];
+
+    literal_init_tables();
+    for (size_t start = 0; start < size; start += LITERAL_LINE_BYTES) {
+        size_t end = start + LITERAL_LINE_BYTES < size ? start + LITERAL_LINE_BYTES : size;
+        char *p = line;
+        *p++ = '"';
+        for (size_t i = start; i < end; ++i) {
+            unsigned char b = bytes[i];
+            unsigned char len = literal_string_len[b];
+            if (len > 1 && len < 4 && i + 1 < end) {
+                unsigned char next = bytes[i + 1];
+                if (next >= '0' && next <= '7') {
+                    memcpy(p, literal_octal_table[b], 4);
+                    p += 4;
+                    continue;
+                }
+            }
+            memcpy(p, literal_string_table[b], 4);
+            p += len;
+        }
+        *p++ = '"';
+        *p++ = '\n';
+        emitter_write(out, line, (size_t)(p - line));
+    }
+    if (size == 0) emitter_puts(out, "\"\"\n");
+}
+
+// Writes `size` bytes as a comma separated decimal list without whitespace
+void literal_emit_decimal(Emitter *out, const unsigned char *bytes, size_t size)
+{
+    char line[LITERAL_LINE_BYTES * 4];
+
+    literal_init_tables();
+    for (size_t start = 0; start < size; start += LITERAL_LINE_BYTES) {
+        size_t end = start + LITERAL_LINE_BYTES < size ? start + LITERAL_LINE_BYTES : size;
+        char *p = line;
+        for (size_t i = start; i < end; ++i) {
+            memcpy(p, literal_decimal_table[bytes[i]], 3);
+            p += literal_decimal_len[bytes[i]];
+            *p++ = ',';
+        }
+        emitter_write(out, line, (size_t)(p - line));
+    }
+}
+
+// The pixels as a byte array aligned for `ctype`, `NAME` stays usable as a pointer
+// to `ctype`
+void literal_emit_array(Emitter *out, const char *name, const char *ctype,
+                        const unsigned char *bytes, size_t size, int decimal)
+{
+    // The explicit size leaves no room for the string terminator, which C allows
+    emitter_printf(out, "_Alignas(%s) const unsigned char %s_BYTES[%zu] = ", ctype, name, size);
+    if (decimal) {
+        emitter_puts(out, "{");
+        literal_emit_decimal(out, bytes, size);
+        emitter_puts(out, "};\n");
+    } else {
+        emitter_puts(out, "\n");
+        literal_emit_string(out, bytes, size);
+        emitter_puts(out, ";\n");
+    }
+    emitter_printf(out, "#define %s ((const %s *)%s_BYTES)\n", name, ctype, name);
+}
+
+#endif // LITERAL_C_
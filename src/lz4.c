@@ -0,0 +1,144 @@
+#ifndef LZ4_C_
+#define LZ4_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./buffer.c"
+#include "./emit.c"
+#include "./timer.c"
+#include "../runtime/image2c_lz4.h"
+
+// LZ4 block compressor for `-c lz4`. Greedy matching through a hash of the next
+// 4 bytes, same as the reference "fast" mode; the result is a standard LZ4 block.
+
+#define LZ4_HASH_BITS   16
+#define LZ4_MIN_MATCH   4
+#define LZ4_MAX_OFFSET  65535
+#define LZ4_LAST_LITERALS 5     // the block always ends with this many literals
+#define LZ4_MATCH_LIMIT 12      // no match may start in the last 12 bytes
+
+static uint32_t lz4_read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static size_t lz4_hash(uint32_t v)
+{
+    return (size_t)((v * 2654435761u) >> (32 - LZ4_HASH_BITS));
+}
+
+static void lz4_length(Byte_Buffer *out, size_t length)
+{
+    while (length >= 255) {
+        byte_buffer_push(out, 255);
+        length -= 255;
+    }
+    byte_buffer_push(out, (unsigned char)length);
+}
+
+static void lz4_sequence(Byte_Buffer *out, const unsigned char *literals, size_t literal_count,
+                         size_t offset, size_t match_length)
+{
+    size_t match_code = match_length ? match_length - LZ4_MIN_MATCH : 0;
+    unsigned token = (unsigned)((literal_count < 15 ? literal_count : 15) << 4);
+    token |= (unsigned)(match_code < 15 ? match_code : 15);
+
+    byte_buffer_reserve(out, literal_count + 16);
+    byte_buffer_push(out, (unsigned char)token);
+    if (literal_count >= 15) lz4_length(out, literal_count - 15);
+    byte_buffer_append(out, literals, literal_count);
+    if (match_length == 0) return;
+
+    byte_buffer_push(out, (unsigned char)(offset & 0xff));
+    byte_buffer_push(out, (unsigned char)(offset >> 8));
+    if (match_code >= 15) lz4_length(out, match_code - 15);
+}
+
+// Compresses `size` bytes into a single LZ4 block
+Byte_Buffer lz4_compress(const unsigned char *src, size_t size)
+{
+    Byte_Buffer out = {0};
+    size_t anchor = 0;
+
+    byte_buffer_reserve(&out, size / 2 + 64);
+    if (size > LZ4_MATCH_LIMIT) {
+        size_t *table = malloc(((size_t)1 << LZ4_HASH_BITS) * sizeof(*table));
+        if (table == NULL) {
+            fprintf(stderr, "ERROR: could not allocate the LZ4 hash table\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < ((size_t)1 << LZ4_HASH_BITS); ++i) table[i] = (size_t)-1;
+
+        size_t limit = size - LZ4_MATCH_LIMIT;
+        size_t i = 0;
+        while (i < limit) {
+            uint32_t sequence = lz4_read32(src + i);
+            size_t h = lz4_hash(sequence);
+            size_t candidate = table[h];
+            table[h] = i;
+
+            if (candidate == (size_t)-1 || i - candidate > LZ4_MAX_OFFSET || lz4_read32(src + candidate) != sequence) {
+                i += 1;
+                continue;
+            }
+
+            size_t length = LZ4_MIN_MATCH;
+            size_t max_length = size - LZ4_LAST_LITERALS - i;
+            while (length < max_length && src[candidate + length] == src[i + length]) length += 1;
+            while (i > anchor && candidate > 0 && src[i - 1] == src[candidate - 1]) {
+                i -= 1;
+                candidate -= 1;
+                length += 1;
+            }
+
+            lz4_sequence(&out, src + anchor, i - anchor, i - candidate, length);
+            i += length;
+            anchor = i;
+            if (i - 2 < limit) table[lz4_hash(lz4_read32(src + i - 2))] = i - 2;
+        }
+        free(table);
+    }
+    lz4_sequence(&out, src + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+// NAME_RAW_SIZE and NAME_UNIT_SIZE for the runtime decoder
+void lz4_emit_info(Emitter *out, const char *name, size_t raw_size, size_t unit_size)
+{
+    emitter_printf(out, "size_t %s_RAW_SIZE = %zu;\n", name, raw_size);
+    emitter_printf(out, "size_t %s_UNIT_SIZE = %zu;\n", name, unit_size);
+}
+
+// Decodes the block back with the runtime decoder, checks it against `raw` and
+// prints the compression ratio and decode throughput
+void lz4_report(const char *filepath, const Byte_Buffer *block, const unsigned char *raw, size_t raw_size)
+{
+    unsigned char *decoded = malloc(raw_size + 1);
+    if (decoded == NULL) return;
+
+    int rounds = 0;
+    long decoded_size = 0;
+    double start = timer_now(), elapsed = 0.0;
+    do {
+        decoded_size = image2c_lz4_decode(block->data, block->size, decoded, raw_size);
+        rounds += 1;
+        elapsed = timer_now() - start;
+    } while (elapsed < 0.05);
+
+    if (decoded_size != (long)raw_size || memcmp(decoded, raw, raw_size) != 0) {
+        fprintf(stderr, "ERROR: %s: LZ4 block does not decode back to the image\n", filepath);
+        exit(1);
+    }
+    fprintf(stderr, "%s: lz4 %zu -> %zu bytes (%.2fx), decode %.1f MB/s\n",
+            filepath, raw_size, block->size,
+            block->size ? (double)raw_size / (double)block->size : 0.0,
+            timer_mbps(raw_size * (size_t)rounds, elapsed));
+    free(decoded);
+}
+
+#endif // LZ4_C_
@@ -1,12 +1,93 @@
+#define _POSIX_C_SOURCE 200809L
+// syscall() for the io_uring backend in io.c
+#define _DEFAULT_SOURCE
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #define SUPPORT_TEXT_MANIPULATION
 #include "./text.c"
+#include "./timer.c"
+#include "./emit.c"
+#include "./embed.c"
+#include "./elf.c"
+#include "./literal.c"
+#include "./pixfmt.c"
+#include "./palette.c"
+#include "./rle.c"
+#include "./lz4.c"
+#include "./tiles.c"
+#include "./qoi.c"
+#include "./texture.c"
+#include "./deflate.c"
+#include "./lazy.c"
+#include "./pipeline.c"
 
+// Threads stb_image may use for the restart intervals of one JPEG, only raised
+// for a single image; batch workers decode their images on one thread each
+static int decode_threads = 1;
+
+typedef struct {
+    void (*run)(void *context, int task);
+    void *context;
+} Decode_Job;
+
+static void decode_task(void *context, size_t task, int worker)
+{
+    Decode_Job *job = context;
+    (void)worker;
+    job->run(job->context, (int)task);
+}
+
+static void decode_parallel_for(int count, void (*run)(void *context, int task), void *context)
+{
+    Decode_Job job = { run, context };
+    pool_run((size_t)count, NULL, decode_threads, decode_task, &job);
+}
+
+#define STBI_PARALLEL_FOR(count, run, context) decode_parallel_for(count, run, context)
+#define STBI_PARALLEL_THREADS() decode_threads
 #define STB_IMAGE_IMPLEMENTATION
 #include "./stb_image.h"
 
+typedef enum {
+    MODE_HEX = 0,       // uint32_t initializer list
+    MODE_EMBED,         // raw .bin sidecar pulled in with #embed
+    MODE_INCBIN,        // raw .bin sidecar pulled in by a .S stub with .incbin
+    MODE_ELF,           // ready to link ELF64 .o plus a declaration-only header
+    MODE_STRING,        // pixel bytes as one escaped string literal
+    MODE_BYTES,         // pixel bytes as a whitespace-free decimal list
+} Mode;
+
+typedef enum {
+    COMPRESS_NONE = 0,
+    COMPRESS_RLE,       // per-row run-length packets, see runtime/image2c_rle.h
+    COMPRESS_LZ4,       // one LZ4 block, see runtime/image2c_lz4.h
+    COMPRESS_QOI,       // the RGBA8 image as QOI, see runtime/image2c_qoi.h
+    COMPRESS_ZLIB,      // zlib stream for stbi_zlib_decode_buffer()
+} Compression;
+
+// Settings shared by every image of the invocation
+typedef struct {
+    bool stats;
+    Mode mode;
+    const char *outdir;
+    int elf_machine;
+    Pixel_Format format;
+    Byte_Order byte_order;
+    Compression compression;
+    int palette_colors;
+    int index_bits;
+    int tile_size;
+    const Texture_Format_Info *texture;
+    Texture_Quality texture_quality;
+    bool lazy;
+    const char *palette_from;
+    size_t read_buffer;         // read() size for inputs that cannot be mapped
+    char palette_name[MAX_TEXT_BUFFER_LENGTH];  // upper case
+    Palette shared_palette;     // built once from palette_from
+} Options;
+
 char *shift(int *argc, char ***argv)
 {
     assert(*argc > 0);
@@ -16,20 +97,95 @@ char *shift(int *argc, char ***argv)
     return result;
 }
 
-int main(int argc, char *argv[])
+// Opens `outdir`/`base_name``extension` for a sidecar file next to the header
+FILE *open_sidecar(const char *outdir, const char *base_name, const char *extension)
 {
-    shift(&argc, &argv);        // skip program name
-
-    if (argc <= 0) {
-        fprintf(stderr, "Usage: ./image2c <filepath.png> <header_name>\n");
-        fprintf(stderr, "ERROR: expected file path\n");
+    char path[2 * MAX_TEXT_BUFFER_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s%s", outdir, base_name, extension);
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open `%s` for writing\n", path);
         exit(1);
     }
+    return f;
+}
+
+// Builds one palette from every image in the comma separated `list`
+void palette_build_from_files(Palette *palette, const char *list, int max_colors, size_t read_buffer)
+{
+    const uint32_t *images[MAX_TEXTSPLIT_COUNT] = {0};
+    size_t counts[MAX_TEXTSPLIT_COUNT] = {0};
+    int image_count = 0;
+    char path[MAX_TEXT_BUFFER_LENGTH];
 
-    char *filepath = shift(&argc, &argv);
+    while (*list != '\0' && image_count < MAX_TEXTSPLIT_COUNT) {
+        const char *comma = strchr(list, ',');
+        size_t len = comma ? (size_t)(comma - list) : strlen(list);
+        if (len >= sizeof(path)) len = sizeof(path) - 1;
+        memcpy(path, list, len);
+        path[len] = '\0';
+        list += comma ? len + 1 : len;
+        if (len == 0) continue;
 
-    int x, y, n;
-    uint32_t *data = (uint32_t *)stbi_load(filepath, &x, &y, &n, 4);
+        int w, h, channels;
+        Io_Input input;
+        unsigned char *rgba = NULL;
+        if (io_input_open(&input, path, read_buffer)) {
+            rgba = stbi_load_from_memory(input.data, (int)input.size, &w, &h, &channels, 4);
+            io_input_close(&input);
+        }
+        if (rgba == NULL) {
+            fprintf(stderr, "Could not load file `%s`\n", path);
+            exit(1);
+        }
+        counts[image_count] = (size_t)w * (size_t)h;
+        images[image_count] = pixfmt_pack(PIXFMT_RGBA8888, rgba, counts[image_count]);
+        stbi_image_free(rgba);
+        image_count += 1;
+    }
+
+    palette_build(palette, images, counts, image_count, max_colors);
+    for (int i = 0; i < image_count; ++i) free((void *)images[i]);
+}
+
+// NAME_PALETTE_SIZE and NAME_PALETTE[] in `format`; a shared palette gets its own
+// guard so every header of the batch can carry it
+void emit_palette(Emitter *out, const char *name, bool shared, const Palette *palette, Pixel_Format format)
+{
+    unsigned char rgba[PALETTE_MAX * 4];
+    for (int i = 0; i < palette->count; ++i) {
+        for (int c = 0; c < 4; ++c) rgba[4 * i + c] = (unsigned char)(palette->colors[i] >> (8 * c));
+    }
+    int unit_size = pixfmt_info[format].unit_size;
+    void *units = pixfmt_pack(format, rgba, (size_t)palette->count);
+    uint32_t *words = pixfmt_widen(units, unit_size, (size_t)palette->count);
+
+    if (shared) {
+        emitter_printf(out, "#ifndef %s_PALETTE_H_\n", name);
+        emitter_printf(out, "#define %s_PALETTE_H_\n", name);
+    }
+    emitter_printf(out, "size_t %s_PALETTE_SIZE = %d;\n", name, palette->count);
+    emitter_printf(out, "%s %s_PALETTE[] = {", pixfmt_info[format].ctype, name);
+    emitter_hex_array(out, words, (size_t)palette->count);
+    emitter_puts(out, "};\n");
+    if (shared) emitter_printf(out, "#endif // %s_PALETTE_H_\n", name);
+
+    free(words);
+    free(units);
+}
+
+// Names derived from an input path: the file name for messages, the base name of
+// the header and sidecar files and the upper case array name
+typedef struct {
+    char file[MAX_TEXT_BUFFER_LENGTH];
+    char base[MAX_TEXT_BUFFER_LENGTH];
+    char header[MAX_TEXT_BUFFER_LENGTH];
+} Image_Names;
+
+// The Text* helpers return static buffers, only call this from the main thread
+void image_names(Image_Names *names, const char *path)
+{
+    char *filepath = (char *)path;
     char* header_name = NULL;
 
     if (TextFindIndex(filepath, "/") != -1) {
@@ -37,7 +193,9 @@ int main(int argc, char *argv[])
         const char* *file_path_array = TextSplit(filepath, '/', &file_path_array_len);
         filepath = (char*)file_path_array[file_path_array_len-1];
     }
-    
+    TextCopy(names->file, filepath);
+    filepath = names->file;
+
     if (TextFindIndex(filepath, ".png") != -1) {
         header_name = TextReplace(filepath, ".png", "");
     }
@@ -46,26 +204,699 @@ int main(int argc, char *argv[])
         header_name = TextReplace(filepath, ".jpg", "");
     }
 
-    header_name = (char*)TextToUpper(header_name);
+    if (TextFindIndex(filepath, ".qoi") != -1) {
+        header_name = TextReplace(filepath, ".qoi", "");
+    }
+
+    // other extensions keep the whole file name
+    TextCopy(names->base, header_name != NULL ? header_name : filepath);
+    TextCopy(names->header, TextToUpper(names->base));
+    free(header_name);
+}
+
+// Converts the image at `path` and writes its header to `out`, the sidecar files go
+// to the output directory. `file` holds the bytes of `path` when they have already
+// been read, NULL otherwise. `jobs` threads work on this image alone.
+void convert_image(const Options *options, const char *path, const Image_Names *names,
+                   const unsigned char *file, size_t file_size, Emitter *out, int jobs)
+{
+    bool stats = options->stats;
+    Mode mode = options->mode;
+    const char *outdir = options->outdir;
+    int elf_machine = options->elf_machine;
+    Pixel_Format format = options->format;
+    Byte_Order byte_order = options->byte_order;
+    Compression compression = options->compression;
+    int palette_colors = options->palette_colors;
+    int index_bits = options->index_bits;
+    int tile_size = options->tile_size;
+    const Texture_Format_Info *texture = options->texture;
+    Texture_Quality texture_quality = options->texture_quality;
+    bool lazy = options->lazy;
+    const char *palette_from = options->palette_from;
+    const char *palette_name = options->palette_name;
+    const char *filepath = names->file;
+    const char *base_name = names->base;
+    const char *header_name = names->header;
 
-    if (data == NULL) {
+    // stb decodes from memory: the mapped file, or the stream read in large chunks
+    // instead of its 128 byte refills
+    Io_Input input = {0};
+    if (file == NULL) {
+        if (!io_input_open(&input, path, options->read_buffer)) {
+            fprintf(stderr, "Could not load file `%s`\n", filepath);
+            exit(1);
+        }
+        file = input.data;
+        file_size = input.size;
+    }
+
+    // the lazy header embeds the file as it is and only needs its size; the pixels
+    // are decoded for --stats to check the accessor against
+    int x, y, n;
+    uint32_t *data = NULL;
+    bool loaded;
+    double decode_start = timer_now();
+    if (lazy && !stats) {
+        loaded = stbi_info_from_memory(file, (int)file_size, &x, &y, &n) != 0;
+    } else {
+        data = (uint32_t *)stbi_load_from_memory(file, (int)file_size, &x, &y, &n, 4);
+        loaded = data != NULL;
+    }
+    double decode_seconds = timer_now() - decode_start;
+
+    if (!loaded) {
         fprintf(stderr, "Could not load file `%s`\n", filepath);
         exit(1);
     }
+    if (stats) {
+        char source[64];
+        if (input.data == NULL) snprintf(source, sizeof(source), "batch read");
+        else if (input.mapped) snprintf(source, sizeof(source), "mapped");
+        else snprintf(source, sizeof(source), "%zu reads", input.reads);
+        fprintf(stderr, "%s: decoded %zu bytes (%s) in %.3f ms\n", filepath, file_size, source, decode_seconds * 1000.0);
+    }
+
+    double start = timer_now();
+
+    size_t count = (size_t)x * (size_t)y;
+    const Pixel_Format_Info *info = &pixfmt_info[format];
+    const char *ctype = info->ctype;
+    int unit_size = info->unit_size;
+    void *units = NULL;
+    size_t size = 0;
+
+    bool indexed = palette_colors > 0 || palette_from != NULL || index_bits > 0;
+    Palette palette = {0};
+    size_t stride = 0;
+    char palette_buffer[MAX_TEXT_BUFFER_LENGTH];
+
+    if (indexed) {
+        int max_colors = palette_colors > 0 ? palette_colors : PALETTE_MAX;
+        if (index_bits > 0 && max_colors > (1 << index_bits)) max_colors = 1 << index_bits;
+
+        uint32_t *words = pixfmt_pack(PIXFMT_RGBA8888, (const unsigned char *)data, count);
+        if (palette_from != NULL) {
+            palette = options->shared_palette;
+            TextCopy(palette_buffer, palette_name);
+        } else {
+            const uint32_t *images[1] = { words };
+            palette_build(&palette, images, &count, 1, max_colors);
+            TextCopy(palette_buffer, header_name);
+        }
+        if (index_bits == 0) index_bits = tile_size > 0 ? 8 : palette_index_bits(palette.count);
+
+        units = palette_map(&palette, words, x, y, index_bits, &stride);
+        free(words);
+        ctype = "uint8_t";
+        unit_size = 1;
+        count = stride * (size_t)y;
+        size = count;
+    } else if (!lazy) {
+        units = pixfmt_pack(format, (const unsigned char *)data, count);
+        size = count * (size_t)unit_size;
+    }
+
+    // Compressed streams are byte arrays, the units are serialized before encoding
+    size_t row_units = indexed ? stride : (size_t)x;
+    size_t raw_size = size;
+    Rle_Image rle = {0};
+    Byte_Buffer block = {0};
+    Tiled_Image tiles = {0};
+    int tile_codec = compression == COMPRESS_RLE ? IMAGE2C_TILE_RLE : IMAGE2C_TILE_LZ4;
+    void *array = units;
+    const char *stbi_format = NULL;
+    if (lazy) {
+        size = file_size;
+        stbi_format = lazy_stbi_format(file, size);
+        if (stats) lazy_report(filepath, file, size, (const unsigned char *)data, x, y);
+        array = (void *)file;
+        count = size;
+    } else if (texture != NULL) {
+        double encode_start = timer_now();
+        block = texture_encode(texture->format, texture_quality, (const unsigned char *)data, (size_t)x, (size_t)y, jobs);
+        double encode_seconds = timer_now() - encode_start;
+        if (stats) texture_report(filepath, texture, texture_quality, &block, encode_seconds,
+                                  (const unsigned char *)data, (size_t)x, (size_t)y);
+        array = block.data;
+        size = block.size;
+        count = size;
+    } else if (compression == COMPRESS_QOI) {
+        double encode_start = timer_now();
+        block = qoi_encode((const unsigned char *)data, x, y);
+        double encode_seconds = timer_now() - encode_start;
+        if (stats) qoi_report(filepath, &block, encode_seconds, (const unsigned char *)data, units,
+                              (int)format, (size_t)unit_size, count);
+        array = block.data;
+        size = block.size;
+        count = size;
+    } else if (compression != COMPRESS_NONE) {
+        unsigned char *bytes = pixfmt_serialize(units, unit_size, count, byte_order);
+        if (tile_size > 0) {
+            tiles = tiles_encode(bytes, (size_t)unit_size, row_units, (size_t)y, (size_t)tile_size, tile_codec);
+            if (stats) tiles_report(filepath, &tiles, bytes, (size_t)unit_size, row_units, (size_t)y,
+                                    (size_t)tile_size, tile_codec);
+            array = tiles.stream.data;
+            size = tiles.stream.size;
+        } else if (compression == COMPRESS_RLE) {
+            rle = rle_encode(bytes, (size_t)unit_size, row_units, (size_t)y);
+            if (stats) rle_report(filepath, &rle, bytes, (size_t)unit_size, row_units);
+            array = rle.stream.data;
+            size = rle.stream.size;
+        } else if (compression == COMPRESS_ZLIB) {
+            double compress_start = timer_now();
+            block = deflate_compress(bytes, raw_size, DEFLATE_CHUNK, jobs);
+            double compress_seconds = timer_now() - compress_start;
+            if (stats) deflate_report(filepath, &block, compress_seconds, jobs, bytes, raw_size);
+            array = block.data;
+            size = block.size;
+        } else {
+            block = lz4_compress(bytes, raw_size);
+            if (stats) lz4_report(filepath, &block, bytes, raw_size);
+            array = block.data;
+            size = block.size;
+        }
+        count = size;
+    }
+    bool byte_array = compression != COMPRESS_NONE || texture != NULL || lazy;
+    int array_unit_size = byte_array ? 1 : unit_size;
+    const char *array_ctype = byte_array ? "uint8_t" : ctype;
 
     // TODO: inclusion guards and the array name are not customizable
-    printf("#ifndef %s_H_\n", header_name);
-    printf("#define %s_H_\n", header_name);
-    printf("size_t %s_WIDTH = %d;\n", header_name, x);
-    printf("size_t %s_HEIGHT = %d;\n", header_name, y);
-    printf("uint32_t %s[] = {", header_name);
-    for (size_t i = 0; i < (size_t)(x * y); ++i) {
-        printf("0x%x, ", data[i]);
+    emitter_header_begin(out, header_name);
+    if (mode != MODE_ELF) emitter_header_size(out, header_name, x, y);
+    if (indexed) {
+        emit_palette(out, palette_buffer, palette_from != NULL, &palette, format);
+        emitter_printf(out, "size_t %s_INDEX_BITS = %d;\n", header_name, index_bits);
+        emitter_printf(out, "size_t %s_STRIDE = %zu;\n", header_name, stride);
+    }
+    if (lazy) {
+        lazy_emit_info(out, header_name, size);
+    } else if (texture != NULL) {
+        texture_emit_info(out, header_name, texture);
+    } else if (tile_size > 0) {
+        tiles_emit_info(out, header_name, &tiles, (size_t)unit_size, (size_t)tile_size, tile_codec);
+    } else if (compression == COMPRESS_RLE) {
+        rle_emit_rows(out, header_name, &rle, (size_t)unit_size, row_units);
+    } else if (compression == COMPRESS_LZ4) {
+        lz4_emit_info(out, header_name, raw_size, (size_t)unit_size);
+    } else if (compression == COMPRESS_QOI) {
+        qoi_emit_info(out, header_name, (int)format, info->name, (size_t)unit_size);
+    } else if (compression == COMPRESS_ZLIB) {
+        deflate_emit_info(out, header_name, raw_size, block.size, (size_t)unit_size);
+    }
+
+    if (mode == MODE_HEX) {
+        uint32_t *words = array_unit_size == 4 ? array : pixfmt_widen(array, array_unit_size, count);
+        emitter_printf(out, "%s %s[] = {", array_ctype, header_name);
+        emitter_hex_array_jobs(out, words, count, jobs);
+        emitter_puts(out, "};\n");
+        if (words != array) free(words);
+    } else {
+        unsigned char *bytes = pixfmt_serialize(array, array_unit_size, count, byte_order);
+
+        if (mode == MODE_STRING || mode == MODE_BYTES) {
+            literal_emit_array(out, header_name, array_ctype, bytes, size, mode == MODE_BYTES);
+        } else if (mode == MODE_ELF) {
+            FILE *object_file = open_sidecar(outdir, base_name, ".o");
+            Emitter object;
+            emitter_init(&object, object_file, EMITTER_CAPACITY);
+            elf_emit_object(&object, header_name, elf_machine, bytes, size, x, y);
+            emitter_free(&object);
+            fclose(object_file);
+            out->total += object.total;
+
+            elf_emit_declarations(out, header_name, array_ctype);
+        } else {
+            char bin_name[MAX_TEXT_BUFFER_LENGTH + 8];
+            char bin_path[2 * MAX_TEXT_BUFFER_LENGTH];
+            snprintf(bin_name, sizeof(bin_name), "%s.bin", base_name);
+            snprintf(bin_path, sizeof(bin_path), "%s/%s", outdir, bin_name);
+            if (!embed_write_file(bin_path, bytes, size)) exit(1);
+            out->total += size;
+
+            if (mode == MODE_EMBED) {
+                embed_emit_array(out, header_name, array_ctype, bin_name);
+            } else {
+                FILE *stub_file = open_sidecar(outdir, base_name, ".S");
+                Emitter stub;
+                emitter_init(&stub, stub_file, MAX_TEXT_BUFFER_LENGTH * 4);
+                incbin_emit_stub(&stub, header_name, bin_name);
+                emitter_free(&stub);
+                fclose(stub_file);
+
+                incbin_emit_declaration(out, header_name, array_ctype);
+            }
+        }
     }
-    printf("};\n");
-    printf("#endif // %s_H_\n", header_name);
+    if (lazy) lazy_emit_accessor(out, header_name, stbi_format);
+    emitter_header_end(out, header_name);
+    emitter_flush(out);
 
+    double elapsed = timer_now() - start;
+    if (stats) {
+        fprintf(stderr, "%s: %dx%d, %zu bytes in %zu writes, %.3f ms, %.1f MB/s (%s)\n",
+                filepath, x, y, out->total, out->writes, elapsed * 1000.0,
+                timer_mbps(out->total, elapsed), emit_kernel_name());
+    }
+    emitter_free(out);
+
+    rle_free(&rle);
+    byte_buffer_free(&block);
+    tiles_free(&tiles);
+    free(units);
+    io_input_close(&input);
     stbi_image_free(data);
+}
+
+typedef struct {
+    const Options *options;
+    char **inputs;
+    Image_Names *names;
+} Batch;
+
+// Decodes and formats one input of the batch into `output`
+static void batch_convert(void *context, Pipeline *p, size_t task,
+                          const unsigned char *file, size_t file_size, Byte_Buffer *output)
+{
+    Batch *batch = context;
+    int w = 0, h = 0, channels;
+    // decoded RGBA8, the packed units and the formatted text of every pixel
+    size_t reserved = 0;
+    if (stbi_info_from_memory(file, (int)file_size, &w, &h, &channels)) reserved = (size_t)w * (size_t)h * (8 + EMIT_HEX_MAX);
+
+    pipeline_reserve(p, reserved);
+    Emitter out;
+    emitter_init_buffer(&out, output, EMITTER_CAPACITY);
+    convert_image(batch->options, batch->inputs[task], &batch->names[task], file, file_size, &out, 1);
+    pipeline_release(p, reserved);
+}
+
+// Parses a byte count with an optional K, M or G suffix, returns 0 when invalid
+size_t parse_memory_size(const char *text)
+{
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) return 0;
+    if (*end == 'K' || *end == 'k') value <<= 10, end += 1;
+    else if (*end == 'M' || *end == 'm') value <<= 20, end += 1;
+    else if (*end == 'G' || *end == 'g') value <<= 30, end += 1;
+    if (*end != '\0') return 0;
+    return (size_t)value;
+}
+
+// Appends every non-empty line of `path` that does not start with '#' to `inputs`
+void read_manifest(const char *path, char ***inputs, size_t *count, size_t *capacity)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open manifest `%s`\n", path);
+        exit(1);
+    }
+    char line[MAX_TEXT_BUFFER_LENGTH];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' ')) line[--len] = '\0';
+        if (len == 0 || line[0] == '#') continue;
+        if (*count == *capacity) {
+            *capacity = *capacity * 2 + 16;
+            *inputs = realloc(*inputs, *capacity * sizeof(**inputs));
+            if (*inputs == NULL) {
+                fprintf(stderr, "ERROR: could not allocate the input list\n");
+                exit(1);
+            }
+        }
+        (*inputs)[(*count)++] = strdup(line);
+    }
+    fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+    shift(&argc, &argv);        // skip program name
+
+    bool stats = false;
+    int jobs = 1;
+    Mode mode = MODE_HEX;
+    const char *outdir = ".";
+    int elf_machine = ELF_MACHINE_HOST;
+    Pixel_Format format = PIXFMT_RGBA8888;
+    Byte_Order byte_order = BYTE_ORDER_LITTLE;
+    Compression compression = COMPRESS_NONE;
+    int palette_colors = 0;
+    int index_bits = 0;
+    int tile_size = 0;
+    const Texture_Format_Info *texture = NULL;
+    Texture_Quality texture_quality = TEXTURE_FAST;
+    bool lazy = false;
+    const char *palette_from = NULL;
+    const char *palette_name = "SHARED";
+    const char *manifest = NULL;
+    size_t max_memory = (size_t)1 << 30;
+    size_t read_buffer = IO_READ_CHUNK;
+    Io_Backend io_backend = IO_POSIX;
+    size_t input_count = 0, input_capacity = (size_t)argc + 16;
+    char **inputs = malloc(input_capacity * sizeof(*inputs));
+
+    while (argc > 0) {
+        char *arg = shift(&argc, &argv);
+        if (TextIsEqual(arg, "-s") || TextIsEqual(arg, "--stats")) {
+            stats = true;
+        } else if (TextIsEqual(arg, "-j") || TextIsEqual(arg, "--jobs")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: %s expects a thread count\n", arg);
+                exit(1);
+            }
+            jobs = TextToInteger(shift(&argc, &argv));
+            if (jobs <= 0) jobs = thread_cpu_count();
+        } else if (TextIsEqual(arg, "-m") || TextIsEqual(arg, "--mode")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: %s expects hex, string, bytes, embed, incbin or elf\n", arg);
+                exit(1);
+            }
+            char *name = shift(&argc, &argv);
+            if (TextIsEqual(name, "hex")) mode = MODE_HEX;
+            else if (TextIsEqual(name, "string")) mode = MODE_STRING;
+            else if (TextIsEqual(name, "bytes")) mode = MODE_BYTES;
+            else if (TextIsEqual(name, "embed")) mode = MODE_EMBED;
+            else if (TextIsEqual(name, "incbin")) mode = MODE_INCBIN;
+            else if (TextIsEqual(name, "elf")) mode = MODE_ELF;
+            else {
+                fprintf(stderr, "ERROR: unknown mode `%s`\n", name);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "--outdir")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --outdir expects a directory\n");
+                exit(1);
+            }
+            outdir = shift(&argc, &argv);
+        } else if (TextIsEqual(arg, "--elf-machine")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --elf-machine expects x86_64, aarch64 or riscv64\n");
+                exit(1);
+            }
+            char *name = shift(&argc, &argv);
+            elf_machine = elf_machine_from_name(name);
+            if (elf_machine < 0) {
+                fprintf(stderr, "ERROR: unknown ELF machine `%s`\n", name);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "-f") || TextIsEqual(arg, "--format")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: %s expects a pixel format\n", arg);
+                exit(1);
+            }
+            char *name = shift(&argc, &argv);
+            int index = pixfmt_from_name(name);
+            if (index < 0) {
+                fprintf(stderr, "ERROR: unknown pixel format `%s`\n", name);
+                exit(1);
+            }
+            format = (Pixel_Format)index;
+        } else if (TextIsEqual(arg, "--byte-order")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --byte-order expects little or big\n");
+                exit(1);
+            }
+            char *name = shift(&argc, &argv);
+            if (TextIsEqual(name, "little")) byte_order = BYTE_ORDER_LITTLE;
+            else if (TextIsEqual(name, "big")) byte_order = BYTE_ORDER_BIG;
+            else {
+                fprintf(stderr, "ERROR: unknown byte order `%s`\n", name);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "-c") || TextIsEqual(arg, "--compress")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: %s expects none, rle, lz4, qoi or zlib\n", arg);
+                exit(1);
+            }
+            char *name = shift(&argc, &argv);
+            if (TextIsEqual(name, "none")) compression = COMPRESS_NONE;
+            else if (TextIsEqual(name, "rle")) compression = COMPRESS_RLE;
+            else if (TextIsEqual(name, "lz4")) compression = COMPRESS_LZ4;
+            else if (TextIsEqual(name, "qoi")) compression = COMPRESS_QOI;
+            else if (TextIsEqual(name, "zlib")) compression = COMPRESS_ZLIB;
+            else {
+                fprintf(stderr, "ERROR: unknown compression `%s`\n", name);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "--tile")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --tile expects a tile size\n");
+                exit(1);
+            }
+            tile_size = TextToInteger(shift(&argc, &argv));
+            if (tile_size < 4 || tile_size > 256) {
+                fprintf(stderr, "ERROR: the tile size must be between 4 and 256\n");
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "-t") || TextIsEqual(arg, "--texture")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: %s expects bc1, bc3, bc4, bc5, etc1 or etc2\n", arg);
+                exit(1);
+            }
+            char *name = shift(&argc, &argv);
+            texture = texture_from_name(name);
+            if (texture == NULL) {
+                fprintf(stderr, "ERROR: unknown texture format `%s`\n", name);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "--quality")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --quality expects fast or high\n");
+                exit(1);
+            }
+            char *name = shift(&argc, &argv);
+            if (TextIsEqual(name, "fast")) texture_quality = TEXTURE_FAST;
+            else if (TextIsEqual(name, "high")) texture_quality = TEXTURE_HIGH;
+            else {
+                fprintf(stderr, "ERROR: unknown quality `%s`\n", name);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "--decode")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --decode expects eager or lazy\n");
+                exit(1);
+            }
+            char *name = shift(&argc, &argv);
+            if (TextIsEqual(name, "eager")) lazy = false;
+            else if (TextIsEqual(name, "lazy")) lazy = true;
+            else {
+                fprintf(stderr, "ERROR: unknown decode `%s`\n", name);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "-p") || TextIsEqual(arg, "--palette")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: %s expects a color count\n", arg);
+                exit(1);
+            }
+            palette_colors = TextToInteger(shift(&argc, &argv));
+            if (palette_colors < 2 || palette_colors > PALETTE_MAX) {
+                fprintf(stderr, "ERROR: the palette needs 2 to %d colors\n", PALETTE_MAX);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "--index-bits")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --index-bits expects 1, 2, 4 or 8\n");
+                exit(1);
+            }
+            index_bits = TextToInteger(shift(&argc, &argv));
+            if (index_bits != 1 && index_bits != 2 && index_bits != 4 && index_bits != 8) {
+                fprintf(stderr, "ERROR: --index-bits expects 1, 2, 4 or 8\n");
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "--palette-from")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --palette-from expects a comma separated list of images\n");
+                exit(1);
+            }
+            palette_from = shift(&argc, &argv);
+        } else if (TextIsEqual(arg, "--palette-name")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --palette-name expects a name\n");
+                exit(1);
+            }
+            palette_name = shift(&argc, &argv);
+        } else if (TextIsEqual(arg, "--simd")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --simd expects scalar, sse2 or avx2\n");
+                exit(1);
+            }
+            char *level = shift(&argc, &argv);
+            if (TextIsEqual(level, "scalar")) emit_set_kernel(EMIT_KERNEL_SCALAR);
+            else if (TextIsEqual(level, "sse2")) emit_set_kernel(EMIT_KERNEL_SSE2);
+            else if (TextIsEqual(level, "avx2")) emit_set_kernel(EMIT_KERNEL_AVX2);
+            else {
+                fprintf(stderr, "ERROR: unknown SIMD level `%s`\n", level);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "--max-memory")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --max-memory expects a size such as 512M\n");
+                exit(1);
+            }
+            char *size = shift(&argc, &argv);
+            max_memory = parse_memory_size(size);
+            if (max_memory == 0) {
+                fprintf(stderr, "ERROR: invalid memory size `%s`\n", size);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "--read-buffer")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --read-buffer expects a size such as 64K\n");
+                exit(1);
+            }
+            char *size = shift(&argc, &argv);
+            read_buffer = parse_memory_size(size);
+            if (read_buffer == 0) {
+                fprintf(stderr, "ERROR: invalid read buffer size `%s`\n", size);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "--io")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --io expects posix or uring\n");
+                exit(1);
+            }
+            char *name = shift(&argc, &argv);
+            if (TextIsEqual(name, "posix")) io_backend = IO_POSIX;
+            else if (TextIsEqual(name, "uring")) io_backend = IO_URING_BACKEND;
+            else {
+                fprintf(stderr, "ERROR: unknown I/O backend `%s`\n", name);
+                exit(1);
+            }
+        } else if (TextIsEqual(arg, "--manifest")) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: --manifest expects a file with one image per line\n");
+                exit(1);
+            }
+            manifest = shift(&argc, &argv);
+        } else {
+            inputs[input_count++] = arg;
+        }
+    }
+
+
+    if (manifest != NULL) read_manifest(manifest, &inputs, &input_count, &input_capacity);
+
+    if (input_count == 0) {
+        fprintf(stderr, "Usage: ./image2c [-s|--stats] [-j N] [-m hex|string|bytes|embed|incbin|elf] [-f FORMAT] [--byte-order little|big] [-c none|rle|lz4|qoi|zlib] [--tile N] [-t bc1|bc3|bc4|bc5|etc1|etc2] [--quality fast|high] [--decode eager|lazy] [-p COLORS] [--index-bits N] [--palette-from A,B,...] [--palette-name NAME] [--outdir DIR] [--manifest FILE] [--max-memory SIZE] [--io posix|uring] [--read-buffer SIZE] [--elf-machine NAME] [--simd scalar|sse2|avx2] <filepath.png>...\n");
+        fprintf(stderr, "ERROR: expected file path\n");
+        exit(1);
+    }
+
+    // tiles are cut on whole units, so indices take a byte each
+    if (tile_size > 0 && index_bits > 0 && index_bits < 8) {
+        fprintf(stderr, "ERROR: --tile needs --index-bits 8\n");
+        exit(1);
+    }
+    if (tile_size > 0 && compression == COMPRESS_NONE) compression = COMPRESS_LZ4;
+    if (tile_size > 0 && compression == COMPRESS_ZLIB) {
+        fprintf(stderr, "ERROR: --tile works with -c rle or lz4\n");
+        exit(1);
+    }
+    // QOI holds the RGBA8 pixels, only the decoder knows about the format
+    if (compression == COMPRESS_QOI && (tile_size > 0 || palette_colors > 0 || palette_from != NULL || index_bits > 0)) {
+        fprintf(stderr, "ERROR: -c qoi cannot be combined with --tile or a palette\n");
+        exit(1);
+    }
+    // texture blocks are encoded from the RGBA8 pixels and stored as they are
+    if (texture != NULL && (compression != COMPRESS_NONE || tile_size > 0 || palette_colors > 0 ||
+                            palette_from != NULL || index_bits > 0)) {
+        fprintf(stderr, "ERROR: -t cannot be combined with -c, --tile or a palette\n");
+        exit(1);
+    }
+    // the embedded file decodes to RGBA8 and nothing else
+    if (lazy && (format != PIXFMT_RGBA8888 || compression != COMPRESS_NONE || tile_size > 0 || texture != NULL ||
+                 palette_colors > 0 || palette_from != NULL || index_bits > 0)) {
+        fprintf(stderr, "ERROR: --decode lazy only keeps the original file, it cannot be combined with -f, -c, -t, --tile or a palette\n");
+        exit(1);
+    }
+
+    Options options = {
+        stats, mode, outdir, elf_machine, format, byte_order, compression, palette_colors, index_bits,
+        tile_size, texture, texture_quality, lazy, palette_from, read_buffer, {0}, {{0}, 0, 0},
+    };
+    TextCopy(options.palette_name, TextToUpper(palette_name));
+    // every image is mapped to the same colors, so they are gathered only once
+    if (palette_from != NULL) {
+        int max_colors = palette_colors > 0 ? palette_colors : PALETTE_MAX;
+        if (index_bits > 0 && max_colors > (1 << index_bits)) max_colors = 1 << index_bits;
+        palette_build_from_files(&options.shared_palette, palette_from, max_colors, read_buffer);
+    }
+
+    Image_Names *names = malloc(input_count * sizeof(*names));
+    if (names == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the input list\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < input_count; ++i) image_names(&names[i], inputs[i]);
+
+    // a single image goes to stdout and keeps the whole -j for itself
+    if (input_count == 1 && manifest == NULL) {
+        Emitter out;
+        emitter_init(&out, stdout, EMITTER_CAPACITY);
+        decode_threads = jobs;
+        convert_image(&options, inputs[0], &names[0], NULL, 0, &out, jobs);
+        free(names);
+        free(inputs);
+        return 0;
+    }
+
+    // the lookup tables are filled once before the workers share them
+    emit_init_tables();
+    emit_kernel_name();
+    literal_init_tables();
+    deflate_init_tables();
+
+    uint64_t *weights = malloc(input_count * sizeof(*weights));
+    for (size_t i = 0; weights != NULL && i < input_count; ++i) {
+        struct stat st;
+        weights[i] = stat(inputs[i], &st) == 0 ? (uint64_t)st.st_size : 0;
+    }
+    if (weights == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the input list\n");
+        exit(1);
+    }
+
+    char **outputs = malloc(input_count * sizeof(*outputs));
+    if (outputs == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the input list\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < input_count; ++i) {
+        size_t len = strlen(outdir) + strlen(names[i].base) + 4;
+        outputs[i] = malloc(len);
+        if (outputs[i] == NULL) {
+            fprintf(stderr, "ERROR: could not allocate the input list\n");
+            exit(1);
+        }
+        snprintf(outputs[i], len, "%s/%s.h", outdir, names[i].base);
+    }
+
+    Batch batch = { &options, inputs, names };
+    Pipeline pipeline = {0};
+    double start = timer_now();
+    pipeline_run(&pipeline, inputs, outputs, weights, input_count, jobs, max_memory, io_backend,
+                 batch_convert, &batch);
+    if (stats) {
+        fprintf(stderr, "batch: %zu images on %d threads, %.3f ms, %zu steals\n",
+                input_count, jobs, (timer_now() - start) * 1000.0, pipeline.steals);
+        fprintf(stderr, "batch: read %.3f ms (%zu of %zu prefetched), write %.3f ms, peak %.1f MB of %.1f MB, "
+                "%zu waits for memory (%.3f ms)\n",
+                pipeline.read_seconds * 1000.0, pipeline.prefetch_hits, input_count, pipeline.write_seconds * 1000.0,
+                (double)pipeline.peak / 1e6, (double)max_memory / 1e6, pipeline.stalls, pipeline.stall_seconds * 1000.0);
+        fprintf(stderr, "batch: %zu syscalls to read in %zu batches (%s), %zu to write in %zu batches (%s), "
+                "%zu for files read by the workers\n",
+                pipeline.read_syscalls, pipeline.read_batches, io_backend_name(pipeline.reader_backend),
+                pipeline.write_syscalls, pipeline.write_batches, io_backend_name(pipeline.writer_backend),
+                pipeline.worker_syscalls);
+    }
 
+    for (size_t i = 0; i < input_count; ++i) free(outputs[i]);
+    free(outputs);
+    free(weights);
+    free(names);
+    free(inputs);
     return 0;
 }
@@ -0,0 +1,307 @@
+#ifndef PALETTE_C_
+#define PALETTE_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Palette quantization for indexed-color output. Colors are 0xAABBGGRR words as
+// returned by stbi_load on little-endian hosts. When the images use no more colors
+// than allowed the palette is exact (in order of first appearance); otherwise it is
+// built with a weighted median cut and every color maps to its nearest entry.
+// Fully transparent pixels are all treated as 0x00000000.
+
+#define PALETTE_MAX 256
+
+typedef struct {
+    uint32_t colors[PALETTE_MAX];
+    int count;
+    int exact;
+} Palette;
+
+// Open addressing color -> count/index table
+typedef struct {
+    uint32_t *keys;
+    uint32_t *counts;
+    unsigned char *used;
+    unsigned char *index;
+    uint32_t *order;        // distinct colors in order of first appearance
+    size_t capacity;
+    size_t size;
+} Color_Table;
+
+static uint32_t palette_normalize(uint32_t color)
+{
+    return (color >> 24) == 0 ? 0 : color;
+}
+
+static size_t palette_hash(uint32_t color, size_t capacity)
+{
+    return (size_t)((color * 2654435761u) ^ (color >> 15)) & (capacity - 1);
+}
+
+static void color_table_init(Color_Table *t, size_t capacity)
+{
+    t->capacity = capacity;
+    t->size = 0;
+    t->keys = malloc(capacity * sizeof(*t->keys));
+    t->counts = malloc(capacity * sizeof(*t->counts));
+    t->used = calloc(capacity, 1);
+    t->index = malloc(capacity);
+    t->order = malloc(capacity * sizeof(*t->order));
+    if (!t->keys || !t->counts || !t->used || !t->index || !t->order) {
+        fprintf(stderr, "ERROR: could not allocate the color table\n");
+        exit(1);
+    }
+}
+
+static void color_table_free(Color_Table *t)
+{
+    free(t->keys);
+    free(t->counts);
+    free(t->used);
+    free(t->index);
+    free(t->order);
+}
+
+static size_t color_table_slot(const Color_Table *t, uint32_t color)
+{
+    size_t slot = palette_hash(color, t->capacity);
+    while (t->used[slot] && t->keys[slot] != color) slot = (slot + 1) & (t->capacity - 1);
+    return slot;
+}
+
+static void color_table_add(Color_Table *t, uint32_t color);
+
+static void color_table_grow(Color_Table *t)
+{
+    Color_Table bigger;
+    color_table_init(&bigger, t->capacity * 2);
+    for (size_t i = 0; i < t->size; ++i) {
+        uint32_t color = t->order[i];
+        color_table_add(&bigger, color);
+        bigger.counts[color_table_slot(&bigger, color)] = t->counts[color_table_slot(t, color)];
+    }
+    color_table_free(t);
+    *t = bigger;
+}
+
+static void color_table_add(Color_Table *t, uint32_t color)
+{
+    if (2 * (t->size + 1) > t->capacity) color_table_grow(t);
+    size_t slot = color_table_slot(t, color);
+    if (!t->used[slot]) {
+        t->used[slot] = 1;
+        t->keys[slot] = color;
+        t->counts[slot] = 0;
+        t->order[t->size++] = color;
+    }
+    t->counts[slot] += 1;
+}
+
+static int palette_channel(uint32_t color, int channel)
+{
+    return (int)((color >> (8 * channel)) & 0xff);
+}
+
+static int palette_distance(uint32_t a, uint32_t b)
+{
+    int d = 0;
+    for (int c = 0; c < 4; ++c) {
+        int diff = palette_channel(a, c) - palette_channel(b, c);
+        d += diff * diff;
+    }
+    return d;
+}
+
+typedef struct {
+    uint32_t color;
+    uint32_t count;
+    int key;                // channel the current box is sorted on
+} Color_Count;
+
+typedef struct {
+    size_t start, end;      // range of entries
+    double error;           // weighted sum of squared distances to the mean
+    int channel;            // channel with the largest spread
+} Color_Box;
+
+static int palette_compare(const void *a, const void *b)
+{
+    int ca = ((const Color_Count *)a)->key;
+    int cb = ((const Color_Count *)b)->key;
+    if (ca != cb) return ca - cb;
+    // tie break on the whole color so the palette does not depend on qsort
+    uint32_t wa = ((const Color_Count *)a)->color, wb = ((const Color_Count *)b)->color;
+    return (wa > wb) - (wa < wb);
+}
+
+static void palette_measure(Color_Box *box, const Color_Count *entries)
+{
+    double best = -1.0;
+    box->error = 0.0;
+    box->channel = 0;
+    for (int c = 0; c < 4; ++c) {
+        double n = 0.0, sum = 0.0, sum2 = 0.0;
+        for (size_t i = box->start; i < box->end; ++i) {
+            double v = palette_channel(entries[i].color, c);
+            n += entries[i].count;
+            sum += v * entries[i].count;
+            sum2 += v * v * entries[i].count;
+        }
+        double spread = sum2 - sum * sum / n;
+        box->error += spread;
+        if (spread > best) {
+            best = spread;
+            box->channel = c;
+        }
+    }
+}
+
+static uint32_t palette_mean(const Color_Box *box, const Color_Count *entries)
+{
+    double n = 0.0, sum[4] = {0};
+    for (size_t i = box->start; i < box->end; ++i) {
+        n += entries[i].count;
+        for (int c = 0; c < 4; ++c) sum[c] += (double)palette_channel(entries[i].color, c) * entries[i].count;
+    }
+    uint32_t color = 0;
+    for (int c = 0; c < 4; ++c) color |= (uint32_t)(sum[c] / n + 0.5) << (8 * c);
+    return color;
+}
+
+static void palette_median_cut(Palette *pal, const Color_Table *t, int max_colors)
+{
+    Color_Count *entries = malloc(t->size * sizeof(*entries));
+    Color_Box boxes[PALETTE_MAX];
+    int box_count = 1;
+
+    if (entries == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the color histogram\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < t->size; ++i) {
+        entries[i].color = t->order[i];
+        entries[i].count = t->counts[color_table_slot(t, t->order[i])];
+    }
+
+    boxes[0].start = 0;
+    boxes[0].end = t->size;
+    palette_measure(&boxes[0], entries);
+
+    while (box_count < max_colors) {
+        int split = -1;
+        for (int i = 0; i < box_count; ++i) {
+            if (boxes[i].end - boxes[i].start < 2) continue;
+            if (split < 0 || boxes[i].error > boxes[split].error) split = i;
+        }
+        if (split < 0) break;
+
+        Color_Box *box = &boxes[split];
+        // the sort key lives in the entries so images can be quantized on several threads
+        for (size_t i = box->start; i < box->end; ++i) entries[i].key = palette_channel(entries[i].color, box->channel);
+        qsort(entries + box->start, box->end - box->start, sizeof(*entries), palette_compare);
+
+        // weighted median, keeping at least one color on each side
+        uint64_t total = 0, running = 0;
+        for (size_t i = box->start; i < box->end; ++i) total += entries[i].count;
+        size_t middle = box->start + 1;
+        for (size_t i = box->start; i < box->end - 1; ++i) {
+            running += entries[i].count;
+            middle = i + 1;
+            if (2 * running >= total) break;
+        }
+
+        Color_Box *upper = &boxes[box_count++];
+        upper->start = middle;
+        upper->end = box->end;
+        box->end = middle;
+        palette_measure(box, entries);
+        palette_measure(upper, entries);
+    }
+
+    pal->count = box_count;
+    for (int i = 0; i < box_count; ++i) pal->colors[i] = palette_mean(&boxes[i], entries);
+    free(entries);
+}
+
+// Builds a palette of at most `max_colors` entries covering all `image_count` images
+void palette_build(Palette *pal, const uint32_t *const *images, const size_t *counts,
+                   int image_count, int max_colors)
+{
+    Color_Table t;
+    color_table_init(&t, 1024);
+    for (int k = 0; k < image_count; ++k) {
+        for (size_t i = 0; i < counts[k]; ++i) color_table_add(&t, palette_normalize(images[k][i]));
+    }
+
+    if (max_colors > PALETTE_MAX) max_colors = PALETTE_MAX;
+    if ((int)t.size <= max_colors) {
+        pal->count = (int)t.size;
+        pal->exact = 1;
+        for (size_t i = 0; i < t.size; ++i) pal->colors[i] = t.order[i];
+    } else {
+        pal->exact = 0;
+        palette_median_cut(pal, &t, max_colors);
+    }
+    color_table_free(&t);
+}
+
+// Smallest of 1, 2, 4 or 8 bits that can index `count` colors
+int palette_index_bits(int count)
+{
+    if (count <= 2) return 1;
+    if (count <= 4) return 2;
+    if (count <= 16) return 4;
+    return 8;
+}
+
+// Maps every pixel to its palette entry and packs the indices `bits` per index,
+// most significant bits first, with every row starting on a byte boundary.
+// Returns the packed rows and stores the row stride in `stride`.
+unsigned char *palette_map(const Palette *pal, const uint32_t *pixels, int width, int height,
+                           int bits, size_t *stride)
+{
+    Color_Table t;
+    size_t row_bytes = ((size_t)width * (size_t)bits + 7) / 8;
+    unsigned char *out = calloc(row_bytes * (size_t)height + 1, 1);
+
+    if (out == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the index array\n");
+        exit(1);
+    }
+
+    // nearest entry for every distinct color, looked up once
+    color_table_init(&t, 1024);
+    for (size_t i = 0; i < (size_t)width * (size_t)height; ++i) color_table_add(&t, palette_normalize(pixels[i]));
+    for (size_t i = 0; i < t.size; ++i) {
+        uint32_t color = t.order[i];
+        int best = 0, best_distance = palette_distance(color, pal->colors[0]);
+        for (int k = 1; k < pal->count && best_distance > 0; ++k) {
+            int d = palette_distance(color, pal->colors[k]);
+            if (d < best_distance) {
+                best = k;
+                best_distance = d;
+            }
+        }
+        t.index[color_table_slot(&t, color)] = (unsigned char)best;
+    }
+
+    int per_byte = 8 / bits;
+    for (int y = 0; y < height; ++y) {
+        unsigned char *row = out + (size_t)y * row_bytes;
+        for (int x = 0; x < width; ++x) {
+            uint32_t color = palette_normalize(pixels[(size_t)y * width + x]);
+            unsigned index = t.index[color_table_slot(&t, color)];
+            int shift = 8 - bits * (x % per_byte + 1);
+            row[x / per_byte] |= (unsigned char)(index << shift);
+        }
+    }
+
+    color_table_free(&t);
+    *stride = row_bytes;
+    return out;
+}
+
+#endif // PALETTE_C_
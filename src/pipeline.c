@@ -0,0 +1,328 @@
+#ifndef PIPELINE_C_
+#define PIPELINE_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./buffer.c"
+#include "./embed.c"
+#include "./io.c"
+#include "./pool.c"
+#include "./thread.c"
+#include "./timer.c"
+
+// Staged batch conversion. A reader thread prefetches the input files in the order
+// the pool will start them, the pool workers decode and format them, and a writer
+// thread stores the finished headers, so disk reads, CPU work and disk writes of
+// different images overlap.
+//
+// Everything the stages hold is counted against a memory budget: prefetched files,
+// the decoded pixels a worker reserves before decoding and the headers waiting for
+// the writer. The reader and the workers wait while the budget is used up, except
+// when nothing is in flight, so a single image larger than the budget still runs.
+// Headers are written as they finish; making them wait for their turn would pin
+// memory behind the slowest image.
+//
+// The reader and the writer each move whole batches of files through io.c, with
+// io_uring when asked for, so thousands of small icons do not cost five syscalls
+// apiece. A worker that gets to a file before the reader reads it on its own.
+
+#define PIPELINE_UNREAD  0
+#define PIPELINE_READING 1
+#define PIPELINE_READY   2
+#define PIPELINE_TAKEN   3
+
+typedef struct Pipeline Pipeline;
+
+// Turns the bytes of input `task` into its header in `output`. Call
+// pipeline_reserve() before allocating the decoded pixels and pipeline_release()
+// once they are freed.
+typedef void (*Pipeline_Convert)(void *context, Pipeline *p, size_t task,
+                                 const unsigned char *file, size_t file_size, Byte_Buffer *output);
+
+typedef struct {
+    int state;
+    unsigned char *file;
+    size_t file_size;
+} Pipeline_Input;
+
+struct Pipeline {
+    char **inputs;
+    char **outputs;             // where the header of every input goes
+    const uint64_t *weights;    // input sizes
+    size_t *order;              // tasks by decreasing size, for the reader and the pool
+    size_t count;
+    Pipeline_Input *items;
+    Byte_Buffer *results;
+    size_t *finished;           // tasks waiting for the writer, in completion order
+    size_t finished_count;
+    size_t written;
+
+    size_t budget;
+    size_t prefetched;          // bytes of files read but not taken by a worker yet
+    size_t working;             // reserved pixels and headers not written yet
+    size_t peak;
+    size_t read_ahead;          // files the reader may hold at once
+    size_t ready;
+    Io_Backend backend;
+
+    Pipeline_Convert convert;
+    void *context;
+    Mutex lock;
+    Cond changed;
+
+    // --stats
+    size_t prefetch_hits;       // files a worker found already read
+    size_t steals;
+    size_t stalls;              // waits for the memory budget
+    double read_seconds, write_seconds, stall_seconds;
+    Io_Backend reader_backend, writer_backend;
+    size_t read_syscalls, write_syscalls, worker_syscalls;
+    size_t read_batches, write_batches;
+};
+
+static void pipeline_track_peak(Pipeline *p)
+{
+    if (p->prefetched + p->working > p->peak) p->peak = p->prefetched + p->working;
+}
+
+// Reads the files of `requests` for `tasks`, exits when one cannot be read
+static void pipeline_read(Pipeline *p, Io *io, Io_Request *requests, const size_t *tasks, size_t count)
+{
+    double start = timer_now();
+    for (size_t i = 0; i < count; ++i) {
+        requests[i] = (Io_Request){ p->inputs[tasks[i]], NULL, (size_t)p->weights[tasks[i]], 0 };
+    }
+    io_read_batch(io, requests, count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!requests[i].ok) {
+            fprintf(stderr, "Could not load file `%s`\n", requests[i].path);
+            exit(1);
+        }
+    }
+    mutex_lock(&p->lock);
+    p->read_seconds += timer_now() - start;
+    mutex_unlock(&p->lock);
+}
+
+// Waits until `bytes` more fit in the budget, then counts them as in flight
+void pipeline_reserve(Pipeline *p, size_t bytes)
+{
+    mutex_lock(&p->lock);
+    if (p->working > 0 && p->prefetched + p->working + bytes > p->budget) {
+        double start = timer_now();
+        p->stalls += 1;
+        while (p->working > 0 && p->prefetched + p->working + bytes > p->budget) cond_wait(&p->changed, &p->lock);
+        p->stall_seconds += timer_now() - start;
+    }
+    p->working += bytes;
+    pipeline_track_peak(p);
+    mutex_unlock(&p->lock);
+}
+
+void pipeline_release(Pipeline *p, size_t bytes)
+{
+    mutex_lock(&p->lock);
+    p->working -= bytes;
+    cond_broadcast(&p->changed);
+    mutex_unlock(&p->lock);
+}
+
+// Whether `task` may be read now, given `pending` bytes claimed but not read yet
+static int pipeline_fits(const Pipeline *p, size_t task, size_t claimed, size_t pending)
+{
+    size_t held = p->prefetched + p->working + pending;
+    return p->ready + claimed < p->read_ahead && (held == 0 || held + p->weights[task] <= p->budget);
+}
+
+static void *pipeline_reader(void *arg)
+{
+    Pipeline *p = arg;
+    const size_t *order = p->order;
+    size_t tasks[IO_BATCH_FILES];
+    Io_Request requests[IO_BATCH_FILES];
+    Io io;
+    p->reader_backend = io_init(&io, p->backend);
+
+    size_t k = 0;
+    while (k < p->count) {
+        // wait for room for the next file, then claim as many as fit
+        mutex_lock(&p->lock);
+        while (p->items[order[k]].state == PIPELINE_UNREAD && !pipeline_fits(p, order[k], 0, 0)) {
+            cond_wait(&p->changed, &p->lock);
+        }
+        size_t count = 0, pending = 0;
+        for (; k < p->count && count < IO_BATCH_FILES; ++k) {
+            size_t task = order[k];
+            if (p->items[task].state != PIPELINE_UNREAD) continue;
+            if (!pipeline_fits(p, task, count, pending)) break;
+            p->items[task].state = PIPELINE_READING;
+            pending += (size_t)p->weights[task];
+            tasks[count++] = task;
+        }
+        mutex_unlock(&p->lock);
+        if (count == 0) continue;
+
+        pipeline_read(p, &io, requests, tasks, count);
+
+        mutex_lock(&p->lock);
+        for (size_t i = 0; i < count; ++i) {
+            Pipeline_Input *item = &p->items[tasks[i]];
+            item->file = requests[i].data;
+            item->file_size = requests[i].size;
+            item->state = PIPELINE_READY;
+            p->prefetched += requests[i].size;
+        }
+        p->ready += count;
+        p->read_batches += 1;
+        pipeline_track_peak(p);
+        cond_broadcast(&p->changed);
+        mutex_unlock(&p->lock);
+    }
+    p->read_syscalls = io.syscalls;
+    io_free(&io);
+    return NULL;
+}
+
+static void *pipeline_writer(void *arg)
+{
+    Pipeline *p = arg;
+    size_t tasks[IO_BATCH_FILES];
+    Io_Request requests[IO_BATCH_FILES];
+    Io io;
+    p->writer_backend = io_init(&io, p->backend);
+
+    for (;;) {
+        mutex_lock(&p->lock);
+        while (p->written == p->finished_count && p->written < p->count) cond_wait(&p->changed, &p->lock);
+        if (p->written == p->count) {
+            mutex_unlock(&p->lock);
+            break;
+        }
+        size_t count = p->finished_count - p->written;
+        if (count > IO_BATCH_FILES) count = IO_BATCH_FILES;
+        memcpy(tasks, p->finished + p->written, count * sizeof(*tasks));
+        mutex_unlock(&p->lock);
+
+        size_t size = 0;
+        for (size_t i = 0; i < count; ++i) {
+            Byte_Buffer *result = &p->results[tasks[i]];
+            requests[i] = (Io_Request){ p->outputs[tasks[i]], result->data, result->size, 0 };
+            size += result->size;
+        }
+        double start = timer_now();
+        io_write_batch(&io, requests, count);
+        double seconds = timer_now() - start;
+        for (size_t i = 0; i < count; ++i) {
+            if (!requests[i].ok) {
+                fprintf(stderr, "ERROR: could not write `%s`\n", requests[i].path);
+                exit(1);
+            }
+            byte_buffer_free(&p->results[tasks[i]]);
+        }
+
+        mutex_lock(&p->lock);
+        p->write_seconds += seconds;
+        p->working -= size;
+        p->written += count;
+        p->write_batches += 1;
+        cond_broadcast(&p->changed);
+        mutex_unlock(&p->lock);
+    }
+    p->write_syscalls = io.syscalls;
+    io_free(&io);
+    return NULL;
+}
+
+static void pipeline_task(void *context, size_t task, int worker)
+{
+    Pipeline *p = context;
+    Pipeline_Input *item = &p->items[task];
+    (void)worker;
+
+    // take the prefetched file, or read it here when the reader has not got to it
+    mutex_lock(&p->lock);
+    while (item->state == PIPELINE_READING) cond_wait(&p->changed, &p->lock);
+    int prefetched = item->state == PIPELINE_READY;
+    if (prefetched) {
+        p->ready -= 1;
+        p->prefetched -= item->file_size;
+        p->prefetch_hits += 1;
+    }
+    item->state = PIPELINE_TAKEN;
+    cond_broadcast(&p->changed);
+    mutex_unlock(&p->lock);
+    if (!prefetched) {
+        Io io;
+        Io_Request request;
+        io_init(&io, IO_POSIX);
+        pipeline_read(p, &io, &request, &task, 1);
+        item->file = request.data;
+        item->file_size = request.size;
+        mutex_lock(&p->lock);
+        p->worker_syscalls += io.syscalls;
+        mutex_unlock(&p->lock);
+    }
+
+    p->convert(p->context, p, task, item->file, item->file_size, &p->results[task]);
+    free(item->file);
+    item->file = NULL;
+
+    mutex_lock(&p->lock);
+    p->working += p->results[task].size;
+    pipeline_track_peak(p);
+    p->finished[p->finished_count++] = task;
+    cond_broadcast(&p->changed);
+    mutex_unlock(&p->lock);
+}
+
+// Converts every input into its output with `thread_count` pool workers plus the
+// reader and writer threads, holding about `budget` bytes at most
+void pipeline_run(Pipeline *p, char **inputs, char **outputs, const uint64_t *weights, size_t count,
+                  int thread_count, size_t budget, Io_Backend backend, Pipeline_Convert convert, void *context)
+{
+    Thread reader, writer;
+
+    p->inputs = inputs;
+    p->outputs = outputs;
+    p->weights = weights;
+    p->count = count;
+    p->budget = budget;
+    p->read_ahead = 2 * (size_t)(thread_count > 0 ? thread_count : 1);
+    if (p->read_ahead < IO_BATCH_FILES) p->read_ahead = IO_BATCH_FILES;
+    p->backend = backend;
+    p->convert = convert;
+    p->context = context;
+    p->items = calloc(count + 1, sizeof(*p->items));
+    p->results = calloc(count + 1, sizeof(*p->results));
+    p->finished = calloc(count + 1, sizeof(*p->finished));
+    p->order = malloc((count + 1) * sizeof(*p->order));
+    if (p->items == NULL || p->results == NULL || p->finished == NULL || p->order == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the pipeline\n");
+        exit(1);
+    }
+    pool_order(p->order, count, weights);
+    mutex_init(&p->lock);
+    cond_init(&p->changed);
+
+    // without a reader the workers read the files themselves
+    int has_reader = thread_create(&reader, pipeline_reader, p);
+    if (!thread_create(&writer, pipeline_writer, p)) {
+        fprintf(stderr, "ERROR: could not start the writer thread\n");
+        exit(1);
+    }
+    p->steals = pool_run(count, p->order, thread_count, pipeline_task, p);
+    thread_join(writer);
+    if (has_reader) thread_join(reader);
+
+    cond_destroy(&p->changed);
+    mutex_destroy(&p->lock);
+    free(p->items);
+    free(p->results);
+    free(p->finished);
+    free(p->order);
+}
+
+#endif // PIPELINE_C_
@@ -0,0 +1,251 @@
+#ifndef PIXFMT_C_
+#define PIXFMT_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(PIXFMT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define PIXFMT_SSE2
+#include <emmintrin.h>
+#endif
+
+// Output pixel formats. Every pixel becomes one 8, 16 or 32-bit unit whose numeric
+// value is defined by the format alone, so headers no longer depend on the byte order
+// of the machine running image2c. Channels are truncated to the target depth.
+typedef enum {
+    PIXFMT_RGBA8888 = 0,    // 0xAABBGGRR, what stbi_load returns read as a little-endian word
+    PIXFMT_RGB565,          // r:5 g:6 b:5, red in the top bits
+    PIXFMT_RGB565_SWAPPED,  // RGB565 with its two bytes exchanged, for SPI displays fed by DMA
+    PIXFMT_RGBA4444,        // r:4 g:4 b:4 a:4, red in the top bits
+    PIXFMT_RGBA5551,        // r:5 g:5 b:5 a:1, red in the top bits
+    PIXFMT_RGB332,          // r:3 g:3 b:2, red in the top bits
+    PIXFMT_L8,              // BT.601 luma
+    PIXFMT_LA8,             // luma in the low byte, alpha in the high byte
+    PIXFMT_COUNT,
+} Pixel_Format;
+
+typedef enum {
+    BYTE_ORDER_LITTLE = 0,
+    BYTE_ORDER_BIG,
+} Byte_Order;
+
+typedef struct {
+    const char *name;
+    int unit_size;          // bytes per pixel
+    const char *ctype;      // C type of one unit in the generated header
+} Pixel_Format_Info;
+
+static const Pixel_Format_Info pixfmt_info[PIXFMT_COUNT] = {
+    [PIXFMT_RGBA8888]      = { "rgba8888",      4, "uint32_t" },
+    [PIXFMT_RGB565]        = { "rgb565",        2, "uint16_t" },
+    [PIXFMT_RGB565_SWAPPED] = { "rgb565_swapped", 2, "uint16_t" },
+    [PIXFMT_RGBA4444]      = { "rgba4444",      2, "uint16_t" },
+    [PIXFMT_RGBA5551]      = { "rgba5551",      2, "uint16_t" },
+    [PIXFMT_RGB332]        = { "rgb332",        1, "uint8_t" },
+    [PIXFMT_L8]            = { "l8",            1, "uint8_t" },
+    [PIXFMT_LA8]           = { "la8",           2, "uint16_t" },
+};
+
+// Looks up a format by name, returns -1 when unknown
+int pixfmt_from_name(const char *name)
+{
+    for (int i = 0; i < PIXFMT_COUNT; ++i) {
+        if (strcmp(pixfmt_info[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static inline uint32_t pixfmt_luma(uint32_t r, uint32_t g, uint32_t b)
+{
+    return (77 * r + 150 * g + 29 * b + 128) >> 8;
+}
+
+// Packs one RGBA8 pixel
+static inline uint32_t pixfmt_pack_one(Pixel_Format format, const unsigned char *p)
+{
+    uint32_t r = p[0], g = p[1], b = p[2], a = p[3];
+
+    switch (format) {
+    case PIXFMT_RGBA8888: return (a << 24) | (b << 16) | (g << 8) | r;
+    case PIXFMT_RGB565: return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    case PIXFMT_RGB565_SWAPPED: {
+        uint32_t v = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        return ((v & 0xff) << 8) | (v >> 8);
+    }
+    case PIXFMT_RGBA4444: return ((r >> 4) << 12) | ((g >> 4) << 8) | ((b >> 4) << 4) | (a >> 4);
+    case PIXFMT_RGBA5551: return ((r >> 3) << 11) | ((g >> 3) << 6) | ((b >> 3) << 1) | (a >> 7);
+    case PIXFMT_RGB332: return ((r >> 5) << 5) | ((g >> 5) << 2) | (b >> 6);
+    case PIXFMT_L8: return pixfmt_luma(r, g, b);
+    case PIXFMT_LA8: return (a << 8) | pixfmt_luma(r, g, b);
+    default: return 0;
+    }
+}
+
+static void pixfmt_store_unit(void *out, size_t i, int unit_size, uint32_t v)
+{
+    switch (unit_size) {
+    case 1: ((uint8_t *)out)[i] = (uint8_t)v; break;
+    case 2: ((uint16_t *)out)[i] = (uint16_t)v; break;
+    default: ((uint32_t *)out)[i] = v; break;
+    }
+}
+
+static void pixfmt_pack_scalar(Pixel_Format format, const unsigned char *rgba, size_t first, size_t count, void *out)
+{
+    int unit_size = pixfmt_info[format].unit_size;
+    for (size_t i = first; i < count; ++i) {
+        pixfmt_store_unit(out, i, unit_size, pixfmt_pack_one(format, rgba + 4 * i));
+    }
+}
+
+#ifdef PIXFMT_SSE2
+// Same as pixfmt_pack_one() for the 4 pixels in `v`, one packed value per 32-bit lane
+static inline __m128i pixfmt_pack_sse2_lanes(Pixel_Format format, __m128i v)
+{
+    const __m128i byte = _mm_set1_epi32(0xff);
+    __m128i r = _mm_and_si128(v, byte);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(v, 8), byte);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(v, 16), byte);
+    __m128i a = _mm_srli_epi32(v, 24);
+    __m128i l;
+
+    switch (format) {
+    case PIXFMT_RGB565:
+    case PIXFMT_RGB565_SWAPPED:
+        v = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(r, 3), 11),
+                                      _mm_slli_epi32(_mm_srli_epi32(g, 2), 5)),
+                         _mm_srli_epi32(b, 3));
+        if (format == PIXFMT_RGB565_SWAPPED) {
+            v = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, byte), 8), _mm_srli_epi32(v, 8));
+        }
+        return v;
+    case PIXFMT_RGBA4444:
+        return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(r, 4), 12),
+                                         _mm_slli_epi32(_mm_srli_epi32(g, 4), 8)),
+                            _mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(b, 4), 4),
+                                         _mm_srli_epi32(a, 4)));
+    case PIXFMT_RGBA5551:
+        return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(r, 3), 11),
+                                         _mm_slli_epi32(_mm_srli_epi32(g, 3), 6)),
+                            _mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(b, 3), 1),
+                                         _mm_srli_epi32(a, 7)));
+    case PIXFMT_RGB332:
+        return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_srli_epi32(r, 5), 5),
+                                         _mm_slli_epi32(_mm_srli_epi32(g, 5), 2)),
+                            _mm_srli_epi32(b, 6));
+    case PIXFMT_L8:
+    case PIXFMT_LA8:
+        // the weighted sum fits in 16 bits and the upper half of every lane is zero,
+        // so the 16-bit multiplies give the full 32-bit products
+        l = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi16(r, _mm_set1_epi32(77)),
+                                        _mm_mullo_epi16(g, _mm_set1_epi32(150))),
+                          _mm_add_epi32(_mm_mullo_epi16(b, _mm_set1_epi32(29)),
+                                        _mm_set1_epi32(128)));
+        l = _mm_srli_epi32(l, 8);
+        if (format == PIXFMT_LA8) l = _mm_or_si128(l, _mm_slli_epi32(a, 8));
+        return l;
+    default:
+        return v;
+    }
+}
+
+// Narrows two vectors of 32-bit lanes holding 16-bit values into 8 uint16 lanes
+static inline __m128i pixfmt_narrow16(__m128i lo, __m128i hi)
+{
+    const __m128i bias = _mm_set1_epi32(0x8000);
+    __m128i packed = _mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias));
+    return _mm_xor_si128(packed, _mm_set1_epi16((short)0x8000));
+}
+
+static size_t pixfmt_pack_sse2(Pixel_Format format, const unsigned char *rgba, size_t count, void *out)
+{
+    int unit_size = pixfmt_info[format].unit_size;
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i v[4];
+        for (int k = 0; k < 4; ++k) {
+            v[k] = pixfmt_pack_sse2_lanes(format, _mm_loadu_si128((const __m128i *)(rgba + 4 * (i + 4 * k))));
+        }
+        if (unit_size == 2) {
+            _mm_storeu_si128((__m128i *)((uint16_t *)out + i), pixfmt_narrow16(v[0], v[1]));
+            _mm_storeu_si128((__m128i *)((uint16_t *)out + i + 8), pixfmt_narrow16(v[2], v[3]));
+        } else {
+            // 8-bit values: 32 -> 16 bits cannot saturate, 16 -> 8 bits neither
+            __m128i lo = _mm_packs_epi32(v[0], v[1]);
+            __m128i hi = _mm_packs_epi32(v[2], v[3]);
+            _mm_storeu_si128((__m128i *)((uint8_t *)out + i), _mm_packus_epi16(lo, hi));
+        }
+    }
+    return i;
+}
+#endif
+
+static int pixfmt_host_is_little(void)
+{
+    const uint32_t probe = 1;
+    return *(const unsigned char *)&probe == 1;
+}
+
+// Packs `count` RGBA8 pixels into a newly allocated array of units
+void *pixfmt_pack(Pixel_Format format, const unsigned char *rgba, size_t count)
+{
+    int unit_size = pixfmt_info[format].unit_size;
+    void *out = malloc(count * (size_t)unit_size + 1);
+    size_t done = 0;
+
+    if (out == NULL) {
+        fprintf(stderr, "ERROR: could not allocate %zu bytes for packed pixels\n", count * (size_t)unit_size);
+        exit(1);
+    }
+    if (format == PIXFMT_RGBA8888 && pixfmt_host_is_little()) {
+        memcpy(out, rgba, count * 4);
+        return out;
+    }
+#ifdef PIXFMT_SSE2
+    if (unit_size < 4) done = pixfmt_pack_sse2(format, rgba, count, out);
+#endif
+    pixfmt_pack_scalar(format, rgba, done, count, out);
+    return out;
+}
+
+// Widens `count` units to uint32_t, for the hex emitter
+uint32_t *pixfmt_widen(const void *units, int unit_size, size_t count)
+{
+    uint32_t *out = malloc(count * sizeof(uint32_t) + 1);
+    if (out == NULL) {
+        fprintf(stderr, "ERROR: could not allocate %zu bytes for packed pixels\n", count * sizeof(uint32_t));
+        exit(1);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        switch (unit_size) {
+        case 1: out[i] = ((const uint8_t *)units)[i]; break;
+        case 2: out[i] = ((const uint16_t *)units)[i]; break;
+        default: out[i] = ((const uint32_t *)units)[i]; break;
+        }
+    }
+    return out;
+}
+
+// Rewrites `count` units in place into the given byte order, for the binary and
+// byte-array outputs, and returns them as bytes
+unsigned char *pixfmt_serialize(void *units, int unit_size, size_t count, Byte_Order order)
+{
+    int little = pixfmt_host_is_little();
+    if (unit_size == 1 || (order == BYTE_ORDER_LITTLE) == little) return units;
+
+    unsigned char *bytes = units;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned char *p = bytes + i * (size_t)unit_size;
+        for (int lo = 0, hi = unit_size - 1; lo < hi; ++lo, --hi) {
+            unsigned char t = p[lo];
+            p[lo] = p[hi];
+            p[hi] = t;
+        }
+    }
+    return bytes;
+}
+
+#endif // PIXFMT_C_
@@ -0,0 +1,162 @@
+#ifndef POOL_C_
+#define POOL_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./thread.c"
+
+// Work-stealing pool for batch conversion. The tasks are sorted by weight (the
+// input file size) and dealt round robin into one deque per worker, so every
+// worker starts on its share of the big images. A worker takes the heaviest task
+// left at the front of its own deque; once it runs dry it steals the lightest one
+// from the back of the fullest deque, which evens out the tail without fighting
+// the owner for the same end.
+
+typedef void (*Pool_Task)(void *context, size_t task, int worker);
+
+typedef struct {
+    size_t *tasks;
+    size_t head, tail;      // tasks[head .. tail) are left
+    Mutex lock;
+} Pool_Deque;
+
+typedef struct {
+    Pool_Deque *deques;
+    int worker_count;
+    Pool_Task run;
+    void *context;
+    Mutex lock;
+    size_t steals;
+} Pool;
+
+typedef struct {
+    Pool *pool;
+    int worker;
+} Pool_Worker;
+
+static const uint64_t *pool_sort_weights;
+
+static int pool_compare(const void *a, const void *b)
+{
+    uint64_t wa = pool_sort_weights[*(const size_t *)a], wb = pool_sort_weights[*(const size_t *)b];
+    if (wa != wb) return wa > wb ? -1 : 1;
+    // ties keep the command line order
+    return (*(const size_t *)a > *(const size_t *)b) - (*(const size_t *)a < *(const size_t *)b);
+}
+
+// Task indices by decreasing weight, the order pool_run() starts them in; without
+// `weights` they keep their own order. Sorts through a global, so only one thread
+// may call it at a time
+void pool_order(size_t *order, size_t count, const uint64_t *weights)
+{
+    for (size_t i = 0; i < count; ++i) order[i] = i;
+    if (weights == NULL) return;
+    pool_sort_weights = weights;
+    qsort(order, count, sizeof(*order), pool_compare);
+}
+
+// Front of the worker's own deque, or the back of the fullest other one
+static int pool_next(Pool *pool, int worker, size_t *task)
+{
+    Pool_Deque *own = &pool->deques[worker];
+    mutex_lock(&own->lock);
+    int found = own->head < own->tail;
+    if (found) *task = own->tasks[own->head++];
+    mutex_unlock(&own->lock);
+    if (found) return 1;
+
+    for (;;) {
+        int victim = -1;
+        size_t most = 0;
+        for (int i = 0; i < pool->worker_count; ++i) {
+            Pool_Deque *d = &pool->deques[i];
+            mutex_lock(&d->lock);
+            size_t left = d->tail - d->head;
+            mutex_unlock(&d->lock);
+            if (left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        if (victim < 0) return 0;
+
+        Pool_Deque *d = &pool->deques[victim];
+        mutex_lock(&d->lock);
+        found = d->head < d->tail;
+        if (found) *task = d->tasks[--d->tail];
+        mutex_unlock(&d->lock);
+        if (found) {
+            mutex_lock(&pool->lock);
+            pool->steals += 1;
+            mutex_unlock(&pool->lock);
+            return 1;
+        }
+    }
+}
+
+static void *pool_worker(void *arg)
+{
+    Pool_Worker *w = arg;
+    size_t task;
+    while (pool_next(w->pool, w->worker, &task)) w->pool->run(w->pool->context, task, w->worker);
+    return NULL;
+}
+
+// Runs `run` for every task 0 .. `count` - 1 on `thread_count` threads, started
+// in `order` from pool_order() (in order when NULL). The calling thread is worker
+// 0. Returns the number of steals.
+size_t pool_run(size_t count, const size_t *order, int thread_count, Pool_Task run, void *context)
+{
+    Pool pool = {0};
+    if (thread_count < 1) thread_count = 1;
+    if ((size_t)thread_count > count) thread_count = count > 0 ? (int)count : 1;
+
+    pool.deques = calloc((size_t)thread_count, sizeof(*pool.deques));
+    Pool_Worker *workers = malloc((size_t)thread_count * sizeof(*workers));
+    Thread *threads = malloc((size_t)thread_count * sizeof(*threads));
+    if (pool.deques == NULL || workers == NULL || threads == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the thread pool\n");
+        exit(1);
+    }
+
+    pool.worker_count = thread_count;
+    pool.run = run;
+    pool.context = context;
+    mutex_init(&pool.lock);
+    for (int i = 0; i < thread_count; ++i) {
+        Pool_Deque *d = &pool.deques[i];
+        d->tasks = malloc((count / (size_t)thread_count + 1) * sizeof(*d->tasks));
+        if (d->tasks == NULL) {
+            fprintf(stderr, "ERROR: could not allocate the thread pool\n");
+            exit(1);
+        }
+        mutex_init(&d->lock);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        Pool_Deque *d = &pool.deques[i % (size_t)thread_count];
+        d->tasks[d->tail++] = order != NULL ? order[i] : i;
+    }
+
+    int started = 1;
+    for (; started < thread_count; ++started) {
+        workers[started] = (Pool_Worker){ &pool, started };
+        if (!thread_create(&threads[started], pool_worker, &workers[started])) break;
+    }
+    workers[0] = (Pool_Worker){ &pool, 0 };
+    pool_worker(&workers[0]);
+    for (int i = 1; i < started; ++i) thread_join(threads[i]);
+
+    for (int i = 0; i < thread_count; ++i) {
+        mutex_destroy(&pool.deques[i].lock);
+        free(pool.deques[i].tasks);
+    }
+    mutex_destroy(&pool.lock);
+    free(pool.deques);
+    free(workers);
+    free(threads);
+    return pool.steals;
+}
+
+#endif // POOL_C_
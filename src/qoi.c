@@ -0,0 +1,145 @@
+#ifndef QOI_C_
+#define QOI_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./buffer.c"
+#include "./emit.c"
+#include "./timer.c"
+#include "../runtime/image2c_qoi.h"
+
+// QOI encoder for `-c qoi`. The whole RGBA8 image is stored as a standard QOI
+// file, runtime/image2c_qoi.h decodes it on the target into the -f format.
+
+static void qoi_put32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+// Encodes `width` x `height` RGBA8 pixels
+Byte_Buffer qoi_encode(const unsigned char *rgba, int width, int height)
+{
+    Byte_Buffer out = {0};
+    size_t count = (size_t)width * (size_t)height;
+    int opaque = 1;
+
+    for (size_t i = 0; i < count && opaque; ++i) opaque = rgba[4 * i + 3] == 255;
+
+    // worst case is one OP_RGBA per pixel
+    byte_buffer_reserve(&out, IMAGE2C_QOI_HEADER_SIZE + count * 5 + IMAGE2C_QOI_PADDING);
+    unsigned char header[IMAGE2C_QOI_HEADER_SIZE] = {'q', 'o', 'i', 'f'};
+    qoi_put32(header + 4, (uint32_t)width);
+    qoi_put32(header + 8, (uint32_t)height);
+    header[12] = opaque ? 3 : 4;
+    header[13] = 0;                 // sRGB with linear alpha
+    byte_buffer_append(&out, header, sizeof(header));
+
+    unsigned char index[64][4] = {{0}};
+    unsigned char prev[4] = {0, 0, 0, 255};
+    unsigned char *p = out.data + out.size;
+    size_t run = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char *px = rgba + 4 * i;
+
+        if (memcmp(px, prev, 4) == 0) {
+            run += 1;
+            if (run == 62 || i + 1 == count) {
+                *p++ = (unsigned char)(IMAGE2C_QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            *p++ = (unsigned char)(IMAGE2C_QOI_OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        unsigned slot = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) & 63;
+        if (memcmp(index[slot], px, 4) == 0) {
+            *p++ = (unsigned char)(IMAGE2C_QOI_OP_INDEX | slot);
+        } else {
+            memcpy(index[slot], px, 4);
+            if (px[3] == prev[3]) {
+                signed char vr = (signed char)(px[0] - prev[0]);
+                signed char vg = (signed char)(px[1] - prev[1]);
+                signed char vb = (signed char)(px[2] - prev[2]);
+                signed char vg_r = (signed char)(vr - vg);
+                signed char vg_b = (signed char)(vb - vg);
+
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    *p++ = (unsigned char)(IMAGE2C_QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                    *p++ = (unsigned char)(IMAGE2C_QOI_OP_LUMA | (vg + 32));
+                    *p++ = (unsigned char)((vg_r + 8) << 4 | (vg_b + 8));
+                } else {
+                    *p++ = IMAGE2C_QOI_OP_RGB;
+                    memcpy(p, px, 3);
+                    p += 3;
+                }
+            } else {
+                *p++ = IMAGE2C_QOI_OP_RGBA;
+                memcpy(p, px, 4);
+                p += 4;
+            }
+        }
+        memcpy(prev, px, 4);
+    }
+
+    static const unsigned char padding[IMAGE2C_QOI_PADDING] = {0, 0, 0, 0, 0, 0, 0, 1};
+    memcpy(p, padding, sizeof(padding));
+    p += sizeof(padding);
+    out.size = (size_t)(p - out.data);
+    return out;
+}
+
+// NAME_QOI_FORMAT and NAME_UNIT_SIZE of the pixels the runtime decoder produces
+void qoi_emit_info(Emitter *out, const char *name, int format, const char *format_name, size_t unit_size)
+{
+    emitter_printf(out, "size_t %s_QOI_FORMAT = %d; // %s\n", name, format, format_name);
+    emitter_printf(out, "size_t %s_UNIT_SIZE = %zu;\n", name, unit_size);
+}
+
+// Decodes the image back with the runtime decoder, checks it against `units` (the
+// pixels in `format`) and prints the compression ratio, the encode time and the
+// decode throughput into RGBA8888 and into `format`
+void qoi_report(const char *filepath, const Byte_Buffer *qoi, double encode_seconds, const unsigned char *rgba,
+                const void *units, int format, size_t unit_size, size_t count)
+{
+    unsigned char *decoded = malloc(count * 4 + 1);
+    if (decoded == NULL) return;
+
+    double mbps[2];
+    for (int pass = 0; pass < 2; ++pass) {
+        int target = pass == 0 ? IMAGE2C_PIXFMT_RGBA8888 : format;
+        size_t target_size = pass == 0 ? 4 : unit_size;
+        const void *expected = pass == 0 ? (const void *)rgba : units;
+        long decoded_count = 0;
+        int rounds = 0;
+        double start = timer_now(), elapsed = 0.0;
+        do {
+            decoded_count = image2c_qoi_decode(qoi->data, qoi->size, decoded, count * 4, target);
+            rounds += 1;
+            elapsed = timer_now() - start;
+        } while (elapsed < 0.05);
+
+        if (decoded_count != (long)count || memcmp(decoded, expected, count * target_size) != 0) {
+            fprintf(stderr, "ERROR: %s: QOI image does not decode back to the pixels\n", filepath);
+            exit(1);
+        }
+        mbps[pass] = timer_mbps(count * 4 * (size_t)rounds, elapsed);
+    }
+
+    fprintf(stderr, "%s: qoi %zu -> %zu bytes (%.2fx), encode %.1f MB/s, decode %.1f MB/s (rgba8888), %.1f MB/s (format)\n",
+            filepath, count * 4, qoi->size, (double)(count * 4) / (double)qoi->size,
+            timer_mbps(count * 4, encode_seconds), mbps[0], mbps[1]);
+    free(decoded);
+}
+
+#endif // QOI_C_
@@ -0,0 +1,121 @@
+#ifndef RLE_C_
+#define RLE_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./buffer.c"
+#include "./emit.c"
+#include "./timer.c"
+#include "../runtime/image2c_rle.h"
+
+// Run-length encoder for `-c rle`, the stream layout is described in
+// runtime/image2c_rle.h which is also what the target decodes it with.
+
+typedef struct {
+    Byte_Buffer stream;
+    uint32_t *rows;         // offset of every row in `stream`, plus the total size
+    size_t row_count;
+} Rle_Image;
+
+static void rle_literal(Byte_Buffer *out, const unsigned char *units, size_t count, size_t unit_size)
+{
+    while (count > 0) {
+        size_t n = count < 128 ? count : 128;
+        byte_buffer_push(out, (unsigned char)(n - 1));
+        byte_buffer_append(out, units, n * unit_size);
+        units += n * unit_size;
+        count -= n;
+    }
+}
+
+static void rle_encode_row(Byte_Buffer *out, const unsigned char *row, size_t row_units, size_t unit_size)
+{
+    // a two unit run of single bytes is not worth breaking a literal for
+    size_t min_run = unit_size == 1 ? 3 : 2;
+    size_t literal_start = 0;
+    size_t i = 0;
+
+    while (i < row_units) {
+        const unsigned char *unit = row + i * unit_size;
+        size_t run = 1;
+        while (i + run < row_units && run < 129 && memcmp(unit, unit + run * unit_size, unit_size) == 0) run += 1;
+
+        if (run >= min_run) {
+            rle_literal(out, row + literal_start * unit_size, i - literal_start, unit_size);
+            byte_buffer_push(out, (unsigned char)(0x80 | (run - 2)));
+            byte_buffer_append(out, unit, unit_size);
+            i += run;
+            literal_start = i;
+        } else {
+            i += 1;
+        }
+    }
+    rle_literal(out, row + literal_start * unit_size, row_units - literal_start, unit_size);
+}
+
+// Encodes `row_count` rows of `row_units` units of `unit_size` bytes
+Rle_Image rle_encode(const unsigned char *units, size_t unit_size, size_t row_units, size_t row_count)
+{
+    Rle_Image image = {0};
+    image.row_count = row_count;
+    image.rows = malloc((row_count + 1) * sizeof(*image.rows));
+    if (image.rows == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the row table\n");
+        exit(1);
+    }
+    for (size_t y = 0; y < row_count; ++y) {
+        image.rows[y] = (uint32_t)image.stream.size;
+        rle_encode_row(&image.stream, units + y * row_units * unit_size, row_units, unit_size);
+    }
+    image.rows[row_count] = (uint32_t)image.stream.size;
+    return image;
+}
+
+void rle_free(Rle_Image *image)
+{
+    byte_buffer_free(&image->stream);
+    free(image->rows);
+}
+
+// NAME_UNIT_SIZE, NAME_ROW_UNITS and the NAME_ROWS[] offset table
+void rle_emit_rows(Emitter *out, const char *name, const Rle_Image *image, size_t unit_size, size_t row_units)
+{
+    emitter_printf(out, "size_t %s_UNIT_SIZE = %zu;\n", name, unit_size);
+    emitter_printf(out, "size_t %s_ROW_UNITS = %zu;\n", name, row_units);
+    emitter_printf(out, "uint32_t %s_ROWS[] = {", name);
+    emitter_hex_array(out, image->rows, image->row_count + 1);
+    emitter_puts(out, "};\n");
+}
+
+// Decodes the stream back with the runtime decoder, checks it against `units` and
+// prints the compression ratio and decode throughput
+void rle_report(const char *filepath, const Rle_Image *image, const unsigned char *units,
+                size_t unit_size, size_t row_units)
+{
+    size_t raw_size = row_units * image->row_count * unit_size;
+    unsigned char *decoded = malloc(raw_size + 1);
+    if (decoded == NULL) return;
+
+    int rounds = 0;
+    double start = timer_now(), elapsed = 0.0;
+    do {
+        image2c_rle_decode(image->stream.data, decoded, row_units, image->row_count, unit_size);
+        rounds += 1;
+        elapsed = timer_now() - start;
+    } while (elapsed < 0.05);
+
+    if (memcmp(decoded, units, raw_size) != 0) {
+        fprintf(stderr, "ERROR: %s: RLE stream does not decode back to the image\n", filepath);
+        exit(1);
+    }
+    fprintf(stderr, "%s: rle %zu -> %zu bytes (%.2fx), decode %.1f MB/s\n",
+            filepath, raw_size, image->stream.size,
+            image->stream.size ? (double)raw_size / (double)image->stream.size : 0.0,
+            timer_mbps(raw_size * (size_t)rounds, elapsed));
+    free(decoded);
+}
+
+#endif // RLE_C_
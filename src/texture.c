@@ -0,0 +1,851 @@
+#ifndef TEXTURE_C_
+#define TEXTURE_C_
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./buffer.c"
+#include "./emit.c"
+#include "./thread.c"
+#include "./timer.c"
+#include "../runtime/image2c_texture.h"
+
+#if !defined(TEXTURE_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define TEXTURE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Block compression encoders for `-t`. Every 4x4 block is encoded on its own from
+// the RGBA8 pixels, so the blocks are spread over the worker threads. Candidate
+// blocks are always scored through the palettes of runtime/image2c_texture.h, the
+// reference decoder, so what is measured is what the target will see.
+//
+// Fast mode fits the BC endpoints to the bounding box of the block (range fit) and
+// picks indices with SSE2. ETC has no endpoints to fit: fast mode quantizes the
+// average of each sub-block as the base color and searches all 8 modifier tables
+// and the selectors for it, in both flips and both base color modes, which makes it
+// far slower than BC. EAC derives base and multiplier from the alpha range and
+// picks indices with SSE2. High quality mode starts BC from the principal axis of
+// the colors and refines the endpoints with least squares, and searches the ETC
+// and EAC base values and multipliers around the first guess.
+
+typedef enum {
+    TEXTURE_FAST = 0,
+    TEXTURE_HIGH,
+} Texture_Quality;
+
+typedef struct {
+    const char *name;
+    int format;             // IMAGE2C_BC1 ...
+    const char *macro;      // name of `format` in the runtime header
+    int channels;           // channels compared for the PSNR report
+} Texture_Format_Info;
+
+static const Texture_Format_Info texture_formats[] = {
+    { "bc1",  IMAGE2C_BC1,  "IMAGE2C_BC1",  4 },
+    { "bc3",  IMAGE2C_BC3,  "IMAGE2C_BC3",  4 },
+    { "bc4",  IMAGE2C_BC4,  "IMAGE2C_BC4",  1 },
+    { "bc5",  IMAGE2C_BC5,  "IMAGE2C_BC5",  2 },
+    { "etc1", IMAGE2C_ETC1, "IMAGE2C_ETC1", 3 },
+    { "etc2", IMAGE2C_ETC2, "IMAGE2C_ETC2", 4 },
+};
+
+#define TEXTURE_FORMAT_COUNT (sizeof(texture_formats) / sizeof(texture_formats[0]))
+
+// Looks up a texture format by name, returns NULL when unknown
+const Texture_Format_Info *texture_from_name(const char *name)
+{
+    for (size_t i = 0; i < TEXTURE_FORMAT_COUNT; ++i) {
+        if (strcmp(texture_formats[i].name, name) == 0) return &texture_formats[i];
+    }
+    return NULL;
+}
+
+static int texture_sq(int v)
+{
+    return v * v;
+}
+
+// Copies the 4x4 block at (bx, by) to `px`, repeating the last column and row
+// past the edges of the image
+static void texture_fetch(const unsigned char *rgba, size_t width, size_t height, size_t bx, size_t by, uint8_t px[64])
+{
+    for (size_t y = 0; y < 4; ++y) {
+        size_t sy = by + y < height ? by + y : height - 1;
+        for (size_t x = 0; x < 4; ++x) {
+            size_t sx = bx + x < width ? bx + x : width - 1;
+            memcpy(px + 4 * (y * 4 + x), rgba + 4 * (sy * width + sx), 4);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// BC4, also the alpha of BC3 and both channels of BC5
+
+// Indices and error of the 16 `values` against the BC4 block in `out`
+static int bc4_assign(const uint8_t values[16], uint8_t out[8])
+{
+    uint8_t palette[8];
+    uint64_t bits = 0;
+    int error = 0;
+
+    image2c_bc4_palette(out, palette);
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, best_error = texture_sq(values[i] - palette[0]);
+        for (int k = 1; k < 8 && best_error > 0; ++k) {
+            int e = texture_sq(values[i] - palette[k]);
+            if (e < best_error) {
+                best = k;
+                best_error = e;
+            }
+        }
+        bits |= (uint64_t)best << (3 * i);
+        error += best_error;
+    }
+    for (int i = 0; i < 6; ++i) out[2 + i] = (uint8_t)(bits >> (8 * i));
+    return error;
+}
+
+static int bc4_try(const uint8_t values[16], int e0, int e1, uint8_t best[8], int best_error)
+{
+    uint8_t block[8] = {(uint8_t)e0, (uint8_t)e1};
+    int error = bc4_assign(values, block);
+    if (error < best_error) {
+        memcpy(best, block, 8);
+        return error;
+    }
+    return best_error;
+}
+
+// Encodes the byte at `channel` of the 16 RGBA pixels
+static void bc4_encode(const uint8_t px[64], int channel, Texture_Quality quality, uint8_t out[8])
+{
+    uint8_t values[16];
+    int lo = 255, hi = 0;
+
+    for (int i = 0; i < 16; ++i) {
+        values[i] = px[4 * i + channel];
+        if (values[i] < lo) lo = values[i];
+        if (values[i] > hi) hi = values[i];
+    }
+
+    // 8 interpolated values between the extremes
+    int error = bc4_try(values, hi, lo, out, 1 << 30);
+    if (quality == TEXTURE_FAST || error == 0) return;
+
+    // pull the endpoints in, the extremes then lose a little for the rest to gain
+    int step = (hi - lo) / 28 > 1 ? (hi - lo) / 28 : 1;
+    for (int d0 = 0; d0 <= 4 * step; d0 += step) {
+        for (int d1 = 0; d1 <= 4 * step; d1 += step) {
+            if (hi - d0 > lo + d1) error = bc4_try(values, hi - d0, lo + d1, out, error);
+        }
+    }
+
+    // 6 values plus exact 0 and 255, for blocks with a few saturated values
+    int inner_lo = 255, inner_hi = 0;
+    for (int i = 0; i < 16; ++i) {
+        if (values[i] == 0 || values[i] == 255) continue;
+        if (values[i] < inner_lo) inner_lo = values[i];
+        if (values[i] > inner_hi) inner_hi = values[i];
+    }
+    if (inner_lo <= inner_hi) bc4_try(values, inner_lo, inner_hi, out, error);
+}
+
+// ---------------------------------------------------------------------------
+// BC1, also the color of BC3
+
+static uint16_t bc1_pack565(const int color[3])
+{
+    int r = color[0] < 0 ? 0 : color[0] > 255 ? 255 : color[0];
+    int g = color[1] < 0 ? 0 : color[1] > 255 ? 255 : color[1];
+    int b = color[2] < 0 ? 0 : color[2] > 255 ? 255 : color[2];
+    return (uint16_t)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | (b * 31 + 127) / 255);
+}
+
+#ifdef TEXTURE_SSE2
+// Nearest of the first 4 palette entries (RGB only) for every pixel, returns the error
+static int bc1_nearest_sse2(const uint8_t px[64], const uint8_t palette[4][4], int indices[16])
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgb = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+    __m128i entries[4];
+    int error = 0;
+
+    for (int k = 0; k < 4; ++k) {
+        entries[k] = _mm_setr_epi16(palette[k][0], palette[k][1], palette[k][2], 0,
+                                    palette[k][0], palette[k][1], palette[k][2], 0);
+    }
+    for (int row = 0; row < 4; ++row) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(px + 16 * row));
+        __m128i lo = _mm_and_si128(_mm_unpacklo_epi8(v, zero), rgb);
+        __m128i hi = _mm_and_si128(_mm_unpackhi_epi8(v, zero), rgb);
+        __m128i best = _mm_set1_epi32(0x7fffffff), best_index = zero;
+
+        for (int k = 0; k < 4; ++k) {
+            __m128i dlo = _mm_sub_epi16(lo, entries[k]);
+            __m128i dhi = _mm_sub_epi16(hi, entries[k]);
+            // r*r + g*g and b*b per pixel, then summed into the low lane of each pixel
+            __m128i slo = _mm_madd_epi16(dlo, dlo);
+            __m128i shi = _mm_madd_epi16(dhi, dhi);
+            slo = _mm_add_epi32(slo, _mm_srli_epi64(slo, 32));
+            shi = _mm_add_epi32(shi, _mm_srli_epi64(shi, 32));
+            __m128i d = _mm_unpacklo_epi64(_mm_shuffle_epi32(slo, _MM_SHUFFLE(3, 1, 2, 0)),
+                                           _mm_shuffle_epi32(shi, _MM_SHUFFLE(3, 1, 2, 0)));
+            __m128i better = _mm_cmplt_epi32(d, best);
+            best = _mm_or_si128(_mm_and_si128(better, d), _mm_andnot_si128(better, best));
+            best_index = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi32(k)), _mm_andnot_si128(better, best_index));
+        }
+
+        int32_t e[4], idx[4];
+        _mm_storeu_si128((__m128i *)e, best);
+        _mm_storeu_si128((__m128i *)idx, best_index);
+        for (int i = 0; i < 4; ++i) {
+            indices[4 * row + i] = idx[i];
+            error += e[i];
+        }
+    }
+    return error;
+}
+
+// Nearest of the 8 `values` for each of the 16 `alpha`, returns the error. The
+// nearest by absolute difference is the nearest by square, so it runs on bytes
+static int eac_nearest_sse2(const uint8_t alpha[16], const uint8_t values[8], uint8_t indices[16])
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128((const __m128i *)alpha);
+    __m128i distances[8], best = _mm_set1_epi8((char)0xff), index = zero;
+
+    for (int k = 0; k < 8; ++k) {
+        __m128i v = _mm_set1_epi8((char)values[k]);
+        distances[k] = _mm_or_si128(_mm_subs_epu8(a, v), _mm_subs_epu8(v, a));
+        best = _mm_min_epu8(best, distances[k]);
+    }
+    // backwards, so the lowest index of a tie is the one that stays
+    for (int k = 7; k >= 0; --k) {
+        __m128i hit = _mm_cmpeq_epi8(distances[k], best);
+        index = _mm_or_si128(_mm_and_si128(hit, _mm_set1_epi8((char)k)), _mm_andnot_si128(hit, index));
+    }
+    _mm_storeu_si128((__m128i *)indices, index);
+
+    __m128i lo = _mm_unpacklo_epi8(best, zero), hi = _mm_unpackhi_epi8(best, zero);
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+#endif
+
+// Fills in the indices of the BC1 block in `out`, whose endpoints are already set,
+// and returns the error. Pixels with alpha below 128 take the transparent entry
+// when `transparent` is set.
+static int bc1_assign(const uint8_t px[64], int four_colors, int transparent, uint8_t out[8])
+{
+    uint8_t palette[4][4];
+    int indices[16];
+    int error = 0;
+
+    image2c_bc1_palette(out, four_colors, palette);
+    // an opaque block that ended up in 3 color mode must not use transparent black
+    if (!transparent) memcpy(palette[3], palette[0], 4);
+#ifdef TEXTURE_SSE2
+    if (!transparent) {
+        error = bc1_nearest_sse2(px, palette, indices);
+    } else
+#endif
+    {
+        int entries = transparent ? 3 : 4;
+        for (int i = 0; i < 16; ++i) {
+            const uint8_t *p = px + 4 * i;
+            if (transparent && p[3] < 128) {
+                indices[i] = 3;
+                continue;
+            }
+            int best = 0, best_error = 1 << 30;
+            for (int k = 0; k < entries; ++k) {
+                int e = texture_sq(p[0] - palette[k][0]) + texture_sq(p[1] - palette[k][1]) + texture_sq(p[2] - palette[k][2]);
+                if (e < best_error) {
+                    best = k;
+                    best_error = e;
+                }
+            }
+            indices[i] = best;
+            error += best_error;
+        }
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i) bits |= (uint32_t)indices[i] << (2 * i);
+    for (int i = 0; i < 4; ++i) out[4 + i] = (uint8_t)(bits >> (8 * i));
+    return error;
+}
+
+// Builds the block for endpoints `a` and `b` in the mode asked for and keeps it in
+// `best` when it beats `best_error`
+static int bc1_try(const uint8_t px[64], const int a[3], const int b[3], int four_colors, int transparent,
+                   uint8_t best[8], int best_error)
+{
+    uint16_t c0 = bc1_pack565(a), c1 = bc1_pack565(b);
+    uint8_t block[8];
+
+    // 4 color blocks need color0 > color1, 3 color blocks the opposite
+    if (transparent ? c0 > c1 : c0 < c1) {
+        uint16_t t = c0;
+        c0 = c1;
+        c1 = t;
+    }
+    block[0] = (uint8_t)c0;
+    block[1] = (uint8_t)(c0 >> 8);
+    block[2] = (uint8_t)c1;
+    block[3] = (uint8_t)(c1 >> 8);
+
+    int error = bc1_assign(px, four_colors, transparent, block);
+    if (error < best_error) {
+        memcpy(best, block, 8);
+        return error;
+    }
+    return best_error;
+}
+
+// Bounding box of the pixels that count, inset by 1/16 of its size
+static void bc1_range_fit(const uint8_t px[64], int transparent, int lo[3], int hi[3])
+{
+#ifdef TEXTURE_SSE2
+    if (!transparent) {
+        __m128i mn = _mm_loadu_si128((const __m128i *)px), mx = mn;
+        for (int row = 1; row < 4; ++row) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(px + 16 * row));
+            mn = _mm_min_epu8(mn, v);
+            mx = _mm_max_epu8(mx, v);
+        }
+        mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+        mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+        mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+        mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+        uint32_t l = (uint32_t)_mm_cvtsi128_si32(mn), h = (uint32_t)_mm_cvtsi128_si32(mx);
+        for (int ch = 0; ch < 3; ++ch) {
+            lo[ch] = (int)(l >> (8 * ch)) & 0xff;
+            hi[ch] = (int)(h >> (8 * ch)) & 0xff;
+        }
+    } else
+#endif
+    {
+        for (int ch = 0; ch < 3; ++ch) {
+            lo[ch] = 255;
+            hi[ch] = 0;
+        }
+        for (int i = 0; i < 16; ++i) {
+            if (transparent && px[4 * i + 3] < 128) continue;
+            for (int ch = 0; ch < 3; ++ch) {
+                if (px[4 * i + ch] < lo[ch]) lo[ch] = px[4 * i + ch];
+                if (px[4 * i + ch] > hi[ch]) hi[ch] = px[4 * i + ch];
+            }
+        }
+    }
+
+    // the box has two diagonals per channel pair, take the one the colors follow
+    // relative to the channel with the widest range
+    int main_channel = 0;
+    for (int ch = 1; ch < 3; ++ch) {
+        if (hi[ch] - lo[ch] > hi[main_channel] - lo[main_channel]) main_channel = ch;
+    }
+    int center[3];
+    for (int ch = 0; ch < 3; ++ch) center[ch] = (lo[ch] + hi[ch] + 1) / 2;
+    for (int ch = 0; ch < 3; ++ch) {
+        if (ch == main_channel) continue;
+        int covariance = 0;
+        for (int i = 0; i < 16; ++i) {
+            if (transparent && px[4 * i + 3] < 128) continue;
+            covariance += (px[4 * i + main_channel] - center[main_channel]) * (px[4 * i + ch] - center[ch]);
+        }
+        if (covariance < 0) {
+            int t = lo[ch];
+            lo[ch] = hi[ch];
+            hi[ch] = t;
+        }
+    }
+    for (int ch = 0; ch < 3; ++ch) {
+        int inset = (hi[ch] - lo[ch]) / 16;
+        lo[ch] += inset;
+        hi[ch] -= inset;
+    }
+}
+
+// Endpoints at the ends of the principal axis of the colors
+static void bc1_principal_fit(const uint8_t px[64], int transparent, int lo[3], int hi[3])
+{
+    double mean[3] = {0}, cov[6] = {0}, n = 0.0;
+
+    for (int i = 0; i < 16; ++i) {
+        if (transparent && px[4 * i + 3] < 128) continue;
+        for (int ch = 0; ch < 3; ++ch) mean[ch] += px[4 * i + ch];
+        n += 1.0;
+    }
+    for (int ch = 0; ch < 3; ++ch) mean[ch] /= n;
+    for (int i = 0; i < 16; ++i) {
+        if (transparent && px[4 * i + 3] < 128) continue;
+        double r = px[4 * i] - mean[0], g = px[4 * i + 1] - mean[1], b = px[4 * i + 2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    double axis[3] = {1.0, 1.0, 1.0};
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        double x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        double y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        double z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        double length = fabs(x) > fabs(y) ? fabs(x) : fabs(y);
+        if (fabs(z) > length) length = fabs(z);
+        if (length < 1e-9) break;
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+    double norm = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for (int ch = 0; ch < 3; ++ch) axis[ch] /= norm;
+
+    double tmin = 0.0, tmax = 0.0;
+    for (int i = 0; i < 16; ++i) {
+        if (transparent && px[4 * i + 3] < 128) continue;
+        double t = 0.0;
+        for (int ch = 0; ch < 3; ++ch) t += (px[4 * i + ch] - mean[ch]) * axis[ch];
+        if (t < tmin) tmin = t;
+        if (t > tmax) tmax = t;
+    }
+    for (int ch = 0; ch < 3; ++ch) {
+        lo[ch] = (int)floor(mean[ch] + axis[ch] * tmin + 0.5);
+        hi[ch] = (int)floor(mean[ch] + axis[ch] * tmax + 0.5);
+    }
+}
+
+// Least squares endpoints for the indices of `block`, returns 0 when they are
+// not determined
+static int bc1_refine(const uint8_t px[64], const uint8_t block[8], int four_colors, int transparent,
+                      int a[3], int b[3])
+{
+    int three = !four_colors && (block[0] | block[1] << 8) <= (block[2] | block[3] << 8);
+    uint32_t bits = block[4] | (uint32_t)block[5] << 8 | (uint32_t)block[6] << 16 | (uint32_t)block[7] << 24;
+    double aa = 0.0, ab = 0.0, bb = 0.0, ax[3] = {0}, bx[3] = {0};
+
+    for (int i = 0; i < 16; ++i) {
+        int index = (bits >> (2 * i)) & 3;
+        if (transparent && (px[4 * i + 3] < 128 || index == 3)) continue;
+        // weight of color1 for every index
+        double w = index == 0 ? 0.0 : index == 1 ? 1.0 : three ? 0.5 : index == 2 ? 1.0 / 3.0 : 2.0 / 3.0;
+        aa += (1.0 - w) * (1.0 - w);
+        ab += (1.0 - w) * w;
+        bb += w * w;
+        for (int ch = 0; ch < 3; ++ch) {
+            ax[ch] += (1.0 - w) * px[4 * i + ch];
+            bx[ch] += w * px[4 * i + ch];
+        }
+    }
+    double det = aa * bb - ab * ab;
+    if (fabs(det) < 1e-9) return 0;
+    for (int ch = 0; ch < 3; ++ch) {
+        a[ch] = (int)floor((ax[ch] * bb - bx[ch] * ab) / det + 0.5);
+        b[ch] = (int)floor((bx[ch] * aa - ax[ch] * ab) / det + 0.5);
+    }
+    return 1;
+}
+
+static void bc1_encode(const uint8_t px[64], int four_colors, Texture_Quality quality, uint8_t out[8])
+{
+    int transparent = 0;
+    if (!four_colors) {
+        for (int i = 0; i < 16; ++i) transparent |= px[4 * i + 3] < 128;
+    }
+
+    int opaque = 0;
+    for (int i = 0; i < 16; ++i) opaque += !transparent || px[4 * i + 3] >= 128;
+    if (opaque == 0) {
+        // nothing but transparent pixels
+        memset(out, 0, 4);
+        memset(out + 4, 0xff, 4);
+        return;
+    }
+
+    int lo[3], hi[3];
+    bc1_range_fit(px, transparent, lo, hi);
+    int error = bc1_try(px, hi, lo, four_colors, transparent, out, 1 << 30);
+    if (quality == TEXTURE_FAST || error == 0) return;
+
+    bc1_principal_fit(px, transparent, lo, hi);
+    error = bc1_try(px, hi, lo, four_colors, transparent, out, error);
+    for (int iteration = 0; iteration < 2 && error > 0; ++iteration) {
+        int a[3], b[3];
+        if (!bc1_refine(px, out, four_colors, transparent, a, b)) break;
+        int refined = bc1_try(px, a, b, four_colors, transparent, out, error);
+        if (refined == error) break;
+        error = refined;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ETC1, also the color of ETC2
+
+typedef struct {
+    int base[3];            // expanded 8-bit base color
+    int table;
+    int selectors[8];       // 0: +a, 1: +b, 2: -a, 3: -b
+    int error;
+} Etc_Fit;
+
+// Best table and selectors of the `count` pixels for one base color
+static void etc1_fit_base(const uint8_t *pixels[8], const int base[3], Etc_Fit *fit)
+{
+    fit->error = 1 << 30;
+    for (int table = 0; table < 8; ++table) {
+        int selectors[8], error = 0, colors[4][3];
+        for (int s = 0; s < 4; ++s) {
+            int modifier = image2c_etc1_modifiers[table][s & 1];
+            if (s & 2) modifier = -modifier;
+            for (int ch = 0; ch < 3; ++ch) colors[s][ch] = image2c_texture_clamp(base[ch] + modifier);
+        }
+        for (int i = 0; i < 8 && error < fit->error; ++i) {
+            int best = 0, best_error = 1 << 30;
+            for (int s = 0; s < 4; ++s) {
+                int e = texture_sq(colors[s][0] - pixels[i][0]) + texture_sq(colors[s][1] - pixels[i][1]) +
+                        texture_sq(colors[s][2] - pixels[i][2]);
+                if (e < best_error) {
+                    best = s;
+                    best_error = e;
+                }
+            }
+            selectors[i] = best;
+            error += best_error;
+        }
+        if (error < fit->error) {
+            fit->error = error;
+            fit->table = table;
+            memcpy(fit->selectors, selectors, sizeof(selectors));
+            memcpy(fit->base, base, sizeof(fit->base));
+        }
+    }
+}
+
+static int etc1_expand(int c, int bits)
+{
+    return bits == 4 ? c << 4 | c : c << 3 | c >> 2;
+}
+
+// Best base color near `quantized` (in `bits` bits per channel), every channel
+// searched over +-`radius`
+static void etc1_fit_quantized(const uint8_t *pixels[8], const int quantized[3], int bits, int radius,
+                               Etc_Fit *fit, int best_quantized[3])
+{
+    int max = (1 << bits) - 1;
+    fit->error = 1 << 30;
+    for (int dr = -radius; dr <= radius; ++dr) {
+        for (int dg = -radius; dg <= radius; ++dg) {
+            for (int db = -radius; db <= radius; ++db) {
+                int q[3] = {quantized[0] + dr, quantized[1] + dg, quantized[2] + db}, base[3];
+                if (q[0] < 0 || q[1] < 0 || q[2] < 0 || q[0] > max || q[1] > max || q[2] > max) continue;
+                for (int ch = 0; ch < 3; ++ch) base[ch] = etc1_expand(q[ch], bits);
+                Etc_Fit candidate;
+                etc1_fit_base(pixels, base, &candidate);
+                if (candidate.error < fit->error) {
+                    *fit = candidate;
+                    memcpy(best_quantized, q, sizeof(q));
+                }
+            }
+        }
+    }
+}
+
+static uint64_t etc1_pack(int differential, int flip, const int q0[3], const int q1[3], const Etc_Fit fits[2])
+{
+    uint64_t bits = 0;
+    for (int ch = 0; ch < 3; ++ch) {
+        if (differential) {
+            bits |= (uint64_t)q0[ch] << (59 - 8 * ch);
+            bits |= (uint64_t)((q1[ch] - q0[ch]) & 7) << (56 - 8 * ch);
+        } else {
+            bits |= (uint64_t)q0[ch] << (60 - 8 * ch);
+            bits |= (uint64_t)q1[ch] << (56 - 8 * ch);
+        }
+    }
+    bits |= (uint64_t)fits[0].table << 37 | (uint64_t)fits[1].table << 34;
+    bits |= (uint64_t)differential << 33 | (uint64_t)flip << 32;
+
+    for (int sub = 0; sub < 2; ++sub) {
+        for (int k = 0; k < 8; ++k) {
+            // k-th pixel of the sub-block, in the order etc1_encode() collected them
+            int x = flip ? k % 4 : 2 * sub + k / 4;
+            int y = flip ? 2 * sub + k / 4 : k % 4;
+            int i = x * 4 + y;
+            bits |= (uint64_t)(fits[sub].selectors[k] >> 1) << (16 + i);
+            bits |= (uint64_t)(fits[sub].selectors[k] & 1) << i;
+        }
+    }
+    return bits;
+}
+
+static void etc1_encode(const uint8_t px[64], Texture_Quality quality, uint8_t out[8])
+{
+    int radius = quality == TEXTURE_HIGH ? 1 : 0;
+    int best_error = 1 << 30;
+    uint64_t best_bits = 0;
+
+    for (int flip = 0; flip < 2; ++flip) {
+        const uint8_t *pixels[2][8];
+        int average[2][3] = {{0}};
+        for (int sub = 0; sub < 2; ++sub) {
+            for (int k = 0; k < 8; ++k) {
+                int x = flip ? k % 4 : 2 * sub + k / 4;
+                int y = flip ? 2 * sub + k / 4 : k % 4;
+                pixels[sub][k] = px + 4 * (y * 4 + x);
+                for (int ch = 0; ch < 3; ++ch) average[sub][ch] += pixels[sub][k][ch];
+            }
+        }
+
+        int q4[2][3], q5[2][3];
+        for (int sub = 0; sub < 2; ++sub) {
+            for (int ch = 0; ch < 3; ++ch) {
+                q4[sub][ch] = (average[sub][ch] * 15 + 8 * 127) / (8 * 255);
+                q5[sub][ch] = (average[sub][ch] * 31 + 8 * 127) / (8 * 255);
+            }
+        }
+
+        // individual mode, 4 bits per channel for each sub-block
+        Etc_Fit fits[2];
+        int q[2][3];
+        etc1_fit_quantized(pixels[0], q4[0], 4, radius, &fits[0], q[0]);
+        etc1_fit_quantized(pixels[1], q4[1], 4, radius, &fits[1], q[1]);
+        if (fits[0].error + fits[1].error < best_error) {
+            best_error = fits[0].error + fits[1].error;
+            best_bits = etc1_pack(0, flip, q[0], q[1], fits);
+        }
+
+        // differential mode, 5 bits per channel and the second color within -4..3
+        etc1_fit_quantized(pixels[0], q5[0], 5, radius, &fits[0], q[0]);
+        int target[3];
+        for (int ch = 0; ch < 3; ++ch) {
+            int d = q5[1][ch] - q[0][ch];
+            target[ch] = q[0][ch] + (d < -4 ? -4 : d > 3 ? 3 : d);
+        }
+        fits[1].error = 1 << 30;
+        for (int dr = -radius; dr <= radius; ++dr) {
+            for (int dg = -radius; dg <= radius; ++dg) {
+                for (int db = -radius; db <= radius; ++db) {
+                    int c[3] = {target[0] + dr, target[1] + dg, target[2] + db}, base[3], ok = 1;
+                    for (int ch = 0; ch < 3; ++ch) {
+                        int d = c[ch] - q[0][ch];
+                        ok &= c[ch] >= 0 && c[ch] <= 31 && d >= -4 && d <= 3;
+                        base[ch] = etc1_expand(c[ch], 5);
+                    }
+                    if (!ok) continue;
+                    Etc_Fit candidate;
+                    etc1_fit_base(pixels[1], base, &candidate);
+                    if (candidate.error < fits[1].error) {
+                        fits[1] = candidate;
+                        memcpy(q[1], c, sizeof(c));
+                    }
+                }
+            }
+        }
+        if (fits[1].error < (1 << 30) && fits[0].error + fits[1].error < best_error) {
+            best_error = fits[0].error + fits[1].error;
+            best_bits = etc1_pack(1, flip, q[0], q[1], fits);
+        }
+    }
+    for (int i = 0; i < 8; ++i) out[i] = (uint8_t)(best_bits >> (56 - 8 * i));
+}
+
+// ---------------------------------------------------------------------------
+// EAC, the alpha of ETC2 RGBA8
+
+// `alpha` in EAC pixel order, down the columns
+static int eac_try(const uint8_t alpha[16], int base, int multiplier, int table, uint64_t *best_bits, int best_error)
+{
+    const int *modifiers = image2c_eac_modifiers[table];
+    uint8_t values[8];
+    uint64_t bits = (uint64_t)base << 56 | (uint64_t)multiplier << 52 | (uint64_t)table << 48;
+    int error = 0;
+
+    for (int k = 0; k < 8; ++k) values[k] = image2c_texture_clamp(base + modifiers[k] * multiplier);
+#ifdef TEXTURE_SSE2
+    uint8_t indices[16];
+    error = eac_nearest_sse2(alpha, values, indices);
+    for (int i = 0; i < 16; ++i) bits |= (uint64_t)indices[i] << (45 - 3 * i);
+#else
+    for (int i = 0; i < 16 && error < best_error; ++i) {
+        int a = alpha[i];
+        int best = 0, e_best = texture_sq(a - values[0]);
+        for (int k = 1; k < 8; ++k) {
+            int e = texture_sq(a - values[k]);
+            if (e < e_best) {
+                best = k;
+                e_best = e;
+            }
+        }
+        bits |= (uint64_t)best << (45 - 3 * i);
+        error += e_best;
+    }
+#endif
+    if (error < best_error) {
+        *best_bits = bits;
+        return error;
+    }
+    return best_error;
+}
+
+static void eac_encode(const uint8_t px[64], Texture_Quality quality, uint8_t out[8])
+{
+    uint8_t alpha[16];
+    int lo = 255, hi = 0;
+    uint64_t bits = 0;
+
+    for (int i = 0; i < 16; ++i) {
+        alpha[i] = px[4 * ((i % 4) * 4 + i / 4) + 3];
+        if (alpha[i] < lo) lo = alpha[i];
+        if (alpha[i] > hi) hi = alpha[i];
+    }
+
+    if (lo == hi) {
+        // table 13 has a 0 modifier at index 4
+        eac_try(alpha, lo, 1, 13, &bits, 1 << 30);
+    } else {
+        int spread = quality == TEXTURE_HIGH ? 2 : 1;
+        int error = 1 << 30;
+        for (int table = 0; table < 16 && error > 0; ++table) {
+            const int *modifiers = image2c_eac_modifiers[table];
+            int span = modifiers[7] - modifiers[3];
+            int multiplier = (hi - lo + span / 2) / span;
+            for (int m = multiplier - spread; m <= multiplier + spread; ++m) {
+                if (m < 1 || m > 15) continue;
+                int base = (lo + hi + 1) / 2 - m * (modifiers[7] + modifiers[3]) / 2;
+                for (int b = base - spread + 1; b <= base + spread - 1; ++b) {
+                    if (b < 0 || b > 255) continue;
+                    error = eac_try(alpha, b, m, table, &bits, error);
+                }
+            }
+        }
+    }
+    for (int i = 0; i < 8; ++i) out[i] = (uint8_t)(bits >> (56 - 8 * i));
+}
+
+// ---------------------------------------------------------------------------
+
+static void texture_encode_block(int format, const uint8_t px[64], Texture_Quality quality, uint8_t *out)
+{
+    switch (format) {
+    case IMAGE2C_BC1: bc1_encode(px, 0, quality, out); break;
+    case IMAGE2C_BC3:
+        bc4_encode(px, 3, quality, out);
+        bc1_encode(px, 1, quality, out + 8);
+        break;
+    case IMAGE2C_BC4: bc4_encode(px, 0, quality, out); break;
+    case IMAGE2C_BC5:
+        bc4_encode(px, 0, quality, out);
+        bc4_encode(px, 1, quality, out + 8);
+        break;
+    case IMAGE2C_ETC1: etc1_encode(px, quality, out); break;
+    case IMAGE2C_ETC2:
+        eac_encode(px, quality, out);
+        etc1_encode(px, quality, out + 8);
+        break;
+    }
+}
+
+typedef struct {
+    int format;
+    Texture_Quality quality;
+    const unsigned char *rgba;
+    size_t width, height;
+    unsigned char *out;
+    size_t rows;            // rows of blocks
+    size_t first, step;     // this worker takes rows first, first + step, ...
+} Texture_Job;
+
+static void *texture_worker(void *arg)
+{
+    Texture_Job *job = arg;
+    size_t across = (job->width + 3) / 4;
+    size_t block_size = image2c_texture_block_size(job->format);
+    uint8_t px[64];
+
+    for (size_t row = job->first; row < job->rows; row += job->step) {
+        unsigned char *out = job->out + row * across * block_size;
+        for (size_t col = 0; col < across; ++col) {
+            texture_fetch(job->rgba, job->width, job->height, 4 * col, 4 * row, px);
+            texture_encode_block(job->format, px, job->quality, out + col * block_size);
+        }
+    }
+    return NULL;
+}
+
+// Encodes the `width` x `height` RGBA8 image into blocks of `format` on
+// `thread_count` threads
+Byte_Buffer texture_encode(int format, Texture_Quality quality, const unsigned char *rgba,
+                           size_t width, size_t height, int thread_count)
+{
+    Byte_Buffer out = {0};
+    size_t rows = (height + 3) / 4;
+    size_t size = rows * ((width + 3) / 4) * image2c_texture_block_size(format);
+
+    byte_buffer_reserve(&out, size);
+    out.size = size;
+    if (thread_count < 1) thread_count = 1;
+    if ((size_t)thread_count > rows) thread_count = rows > 0 ? (int)rows : 1;
+
+    Texture_Job *jobs = malloc((size_t)thread_count * sizeof(*jobs));
+    Thread *threads = malloc((size_t)thread_count * sizeof(*threads));
+    if (jobs == NULL || threads == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the texture jobs\n");
+        exit(1);
+    }
+    int started = 1;
+    for (int i = 0; i < thread_count; ++i) {
+        jobs[i] = (Texture_Job){ format, quality, rgba, width, height, out.data, rows, (size_t)i, (size_t)thread_count };
+    }
+    for (; started < thread_count; ++started) {
+        if (!thread_create(&threads[started], texture_worker, &jobs[started])) break;
+    }
+    // the calling thread takes the first share and every share that could not start
+    texture_worker(&jobs[0]);
+    for (int i = started; i < thread_count; ++i) texture_worker(&jobs[i]);
+    for (int i = 1; i < started; ++i) thread_join(threads[i]);
+
+    free(jobs);
+    free(threads);
+    return out;
+}
+
+// NAME_TEXTURE_FORMAT and NAME_BLOCK_SIZE for the runtime decoder
+void texture_emit_info(Emitter *out, const char *name, const Texture_Format_Info *info)
+{
+    emitter_printf(out, "size_t %s_TEXTURE_FORMAT = %d; // %s\n", name, info->format, info->macro);
+    emitter_printf(out, "size_t %s_BLOCK_SIZE = %zu;\n", name, image2c_texture_block_size(info->format));
+}
+
+// Decodes the blocks with the reference decoder and prints the ratio, the encode
+// throughput and the PSNR over the channels the format keeps
+void texture_report(const char *filepath, const Texture_Format_Info *info, Texture_Quality quality,
+                    const Byte_Buffer *blocks, double encode_seconds, const unsigned char *rgba,
+                    size_t width, size_t height)
+{
+    size_t raw_size = width * height * 4;
+    unsigned char *decoded = malloc(raw_size + 1);
+    if (decoded == NULL) return;
+
+    image2c_texture_decode(info->format, blocks->data, width, height, decoded);
+    double sum = 0.0;
+    for (size_t i = 0; i < width * height; ++i) {
+        for (int ch = 0; ch < info->channels; ++ch) {
+            double d = (double)decoded[4 * i + ch] - (double)rgba[4 * i + ch];
+            sum += d * d;
+        }
+    }
+    double mse = sum / ((double)width * (double)height * info->channels);
+    double psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+
+    fprintf(stderr, "%s: %s %s, %zu -> %zu bytes (%.2fx), encode %.1f MB/s, PSNR %.2f dB\n",
+            filepath, info->name, quality == TEXTURE_HIGH ? "high" : "fast", raw_size, blocks->size,
+            (double)raw_size / (double)blocks->size, timer_mbps(raw_size, encode_seconds), psnr);
+    free(decoded);
+}
+
+#endif // TEXTURE_C_
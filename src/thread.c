@@ -0,0 +1,99 @@
+#ifndef THREAD_C_
+#define THREAD_C_
+
+// Minimal threads, mutexes and condition variables on top of Win32 or pthreads
+
+#if defined(_WIN32)
+#include <windows.h>
+
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Cond;
+
+typedef struct {
+    void *(*fn)(void *);
+    void *arg;
+} Thread_Start;
+
+static DWORD WINAPI thread_trampoline(LPVOID param)
+{
+    Thread_Start start = *(Thread_Start *)param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+int thread_create(Thread *t, void *(*fn)(void *), void *arg)
+{
+    Thread_Start *start = malloc(sizeof(*start));
+    if (start == NULL) return 0;
+    start->fn = fn;
+    start->arg = arg;
+    *t = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (*t == NULL) {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void thread_join(Thread t)
+{
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+
+int thread_cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+
+void mutex_init(Mutex *m)        { InitializeCriticalSection(m); }
+void mutex_destroy(Mutex *m)     { DeleteCriticalSection(m); }
+void mutex_lock(Mutex *m)        { EnterCriticalSection(m); }
+void mutex_unlock(Mutex *m)      { LeaveCriticalSection(m); }
+
+void cond_init(Cond *c)          { InitializeConditionVariable(c); }
+void cond_destroy(Cond *c)       { (void)c; }
+void cond_wait(Cond *c, Mutex *m) { SleepConditionVariableCS(c, m, INFINITE); }
+void cond_signal(Cond *c)        { WakeConditionVariable(c); }
+void cond_broadcast(Cond *c)     { WakeAllConditionVariable(c); }
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Cond;
+
+int thread_create(Thread *t, void *(*fn)(void *), void *arg)
+{
+    return pthread_create(t, NULL, fn, arg) == 0;
+}
+
+void thread_join(Thread t)
+{
+    pthread_join(t, NULL);
+}
+
+int thread_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+void mutex_init(Mutex *m)        { pthread_mutex_init(m, NULL); }
+void mutex_destroy(Mutex *m)     { pthread_mutex_destroy(m); }
+void mutex_lock(Mutex *m)        { pthread_mutex_lock(m); }
+void mutex_unlock(Mutex *m)      { pthread_mutex_unlock(m); }
+
+void cond_init(Cond *c)          { pthread_cond_init(c, NULL); }
+void cond_destroy(Cond *c)       { pthread_cond_destroy(c); }
+void cond_wait(Cond *c, Mutex *m) { pthread_cond_wait(c, m); }
+void cond_signal(Cond *c)        { pthread_cond_signal(c); }
+void cond_broadcast(Cond *c)     { pthread_cond_broadcast(c); }
+#endif
+
+#endif // THREAD_C_
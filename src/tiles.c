@@ -0,0 +1,143 @@
+#ifndef TILES_C_
+#define TILES_C_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./buffer.c"
+#include "./emit.c"
+#include "./timer.c"
+#include "./rle.c"
+#include "./lz4.c"
+#include "../runtime/image2c_tiles.h"
+
+// Tiled compression for `--tile N`: every N x N tile is compressed on its own with
+// RLE or LZ4 so the target can decode any rectangle through runtime/image2c_tiles.h
+// without touching the tiles outside of it.
+
+typedef struct {
+    Byte_Buffer stream;
+    uint32_t *offsets;      // offset of every tile in `stream`, plus the total size
+    size_t tile_count;
+} Tiled_Image;
+
+// Encodes `width` x `height` units of `unit_size` bytes as `tile` x `tile` tiles
+// with `codec`, one of IMAGE2C_TILE_RLE or IMAGE2C_TILE_LZ4
+Tiled_Image tiles_encode(const unsigned char *units, size_t unit_size, size_t width, size_t height,
+                         size_t tile, int codec)
+{
+    Tiled_Image image = {0};
+    size_t across = (width + tile - 1) / tile;
+    size_t down = (height + tile - 1) / tile;
+    unsigned char *scratch = malloc(tile * tile * unit_size + 1);
+
+    image.tile_count = across * down;
+    image.offsets = malloc((image.tile_count + 1) * sizeof(*image.offsets));
+    if (scratch == NULL || image.offsets == NULL) {
+        fprintf(stderr, "ERROR: could not allocate the tile table\n");
+        exit(1);
+    }
+
+    for (size_t ty = 0; ty < down; ++ty) {
+        for (size_t tx = 0; tx < across; ++tx) {
+            size_t tw = width - tx * tile < tile ? width - tx * tile : tile;
+            size_t th = height - ty * tile < tile ? height - ty * tile : tile;
+            size_t row_bytes = tw * unit_size;
+
+            // gather the tile rows next to each other
+            for (size_t row = 0; row < th; ++row) {
+                memcpy(scratch + row * row_bytes, units + ((ty * tile + row) * width + tx * tile) * unit_size, row_bytes);
+            }
+
+            image.offsets[ty * across + tx] = (uint32_t)image.stream.size;
+            if (codec == IMAGE2C_TILE_RLE) {
+                for (size_t row = 0; row < th; ++row) {
+                    rle_encode_row(&image.stream, scratch + row * row_bytes, tw, unit_size);
+                }
+            } else {
+                Byte_Buffer block = lz4_compress(scratch, th * row_bytes);
+                byte_buffer_append(&image.stream, block.data, block.size);
+                byte_buffer_free(&block);
+            }
+        }
+    }
+    image.offsets[image.tile_count] = (uint32_t)image.stream.size;
+    free(scratch);
+    return image;
+}
+
+void tiles_free(Tiled_Image *image)
+{
+    byte_buffer_free(&image->stream);
+    free(image->offsets);
+}
+
+// NAME_UNIT_SIZE, NAME_TILE_SIZE, NAME_TILE_CODEC and the NAME_TILES[] offset table
+void tiles_emit_info(Emitter *out, const char *name, const Tiled_Image *image, size_t unit_size,
+                     size_t tile, int codec)
+{
+    emitter_printf(out, "size_t %s_UNIT_SIZE = %zu;\n", name, unit_size);
+    emitter_printf(out, "size_t %s_TILE_SIZE = %zu;\n", name, tile);
+    emitter_printf(out, "size_t %s_TILE_CODEC = %d; // %s\n", name, codec,
+                   codec == IMAGE2C_TILE_RLE ? "IMAGE2C_TILE_RLE" : "IMAGE2C_TILE_LZ4");
+    emitter_printf(out, "uint32_t %s_TILES[] = {", name);
+    emitter_hex_array(out, image->offsets, image->tile_count + 1);
+    emitter_puts(out, "};\n");
+}
+
+// Reads the whole image back through the runtime accessor and checks it against
+// `units`, then prints the compression ratio, the full decode throughput and the
+// time to read a window a quarter of the image wide and high
+void tiles_report(const char *filepath, const Tiled_Image *image, const unsigned char *units,
+                  size_t unit_size, size_t width, size_t height, size_t tile, int codec)
+{
+    size_t raw_size = width * height * unit_size;
+    unsigned char *decoded = malloc(raw_size + 1);
+    unsigned char *scratch = malloc(tile * tile * unit_size + 1);
+    image2c_tiles t = { image->stream.data, image->offsets, (uint32_t)width, (uint32_t)height,
+                        (uint32_t)tile, (uint32_t)unit_size, (uint32_t)codec };
+    if (decoded == NULL || scratch == NULL) {
+        free(decoded);
+        free(scratch);
+        return;
+    }
+
+    int rounds = 0;
+    double start = timer_now(), elapsed = 0.0;
+    do {
+        if (image2c_tiles_read(&t, 0, 0, t.width, t.height, decoded, width * unit_size, scratch) != 0) break;
+        rounds += 1;
+        elapsed = timer_now() - start;
+    } while (elapsed < 0.05);
+
+    if (rounds == 0 || memcmp(decoded, units, raw_size) != 0) {
+        fprintf(stderr, "ERROR: %s: tiles do not decode back to the image\n", filepath);
+        exit(1);
+    }
+
+    uint32_t window_w = t.width / 4 ? t.width / 4 : 1, window_h = t.height / 4 ? t.height / 4 : 1;
+    int window_rounds = 0;
+    double window_start = timer_now(), window_elapsed = 0.0;
+    do {
+        // slide the window around so every call decodes a different set of tiles
+        uint32_t wx = (uint32_t)(window_rounds * 37u) % (t.width - window_w + 1);
+        uint32_t wy = (uint32_t)(window_rounds * 23u) % (t.height - window_h + 1);
+        image2c_tiles_read(&t, wx, wy, window_w, window_h, decoded, window_w * unit_size, scratch);
+        window_rounds += 1;
+        window_elapsed = timer_now() - window_start;
+    } while (window_elapsed < 0.05);
+
+    fprintf(stderr, "%s: %zu %s tiles of %zux%zu, %zu -> %zu bytes (%.2fx), decode %.1f MB/s, "
+            "%ux%u window %.3f ms\n",
+            filepath, image->tile_count, codec == IMAGE2C_TILE_RLE ? "rle" : "lz4", tile, tile,
+            raw_size, image->stream.size + (image->tile_count + 1) * sizeof(uint32_t),
+            (double)raw_size / (double)(image->stream.size + (image->tile_count + 1) * sizeof(uint32_t)),
+            timer_mbps(raw_size * (size_t)rounds, elapsed),
+            window_w, window_h, window_elapsed * 1000.0 / window_rounds);
+    free(decoded);
+    free(scratch);
+}
+
+#endif // TILES_C_
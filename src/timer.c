@@ -0,0 +1,33 @@
+#ifndef TIMER_C_
+#define TIMER_C_
+
+// Wall clock in seconds, used for the throughput reports printed with --stats
+#if defined(_WIN32)
+#include <windows.h>
+
+double timer_now(void)
+{
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+}
+#else
+#include <time.h>
+
+double timer_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+#endif
+
+// Megabytes per second for `bytes` processed in `seconds`
+double timer_mbps(size_t bytes, double seconds)
+{
+    if (seconds <= 0.0) return 0.0;
+    return (double)bytes / (1024.0 * 1024.0) / seconds;
+}
+
+#endif // TIMER_C_